@@ -11,8 +11,11 @@
 
 #include "cmdline.h"
 #include "debug.h"
+#include "evaluate.h"
 #include "hash.h"
+#include "options.h"
 #include "position.h"
+#include "search.h"
 
 void display_usage(void);
 
@@ -36,6 +39,36 @@ int arg_filename(struct cmdline *cmdl) {
   return 0;
 }
 
+int arg_pawn_hash(struct cmdline *cmdl) {
+  const char *arg = cmdline_get(cmdl);
+  if (sscanf(arg, "%d", &pawn_hash_mb) != 1 || pawn_hash_mb < 0 ||
+      pawn_hash_mb > PAWN_HASH_MAX_MB)
+    return 1;
+  return 0;
+}
+
+int arg_no_pvs(struct cmdline *cmdl) {
+  pvs_enabled = 0;
+  return 0;
+}
+
+int arg_window(struct cmdline *cmdl) {
+  const char *arg = cmdline_get(cmdl);
+  if (!arg || sscanf(arg, "%d", &aspiration_window) != 1 ||
+      aspiration_window < 0)
+    return 1;
+  return 0;
+}
+
+int arg_option(struct cmdline *cmdl) {
+  const char *arg = cmdline_get(cmdl);
+  if (!arg || set_option_arg(0, arg)) {
+    printf("Invalid option %s\n", arg ? arg : "");
+    return 1;
+  }
+  return 0;
+}
+
 int arg_help(struct cmdline *cmdl) {
   display_usage();
   return 1;
@@ -45,6 +78,11 @@ int arg_help(struct cmdline *cmdl) {
 const struct cmdline_def arg_defs[] = {
     {0, "", arg_filename, "Input EPD filename", "FILE"},
     {'d', "depth", arg_depth, "Search depth", "N"},
+    {'p', "pawn-hash", arg_pawn_hash, "Pawn hash size, 0 to disable", "MB"},
+    {'n', "no-pvs", arg_no_pvs, "Search every move with the full window", ""},
+    {'w', "window", arg_window, "Aspiration window, 0 to disable", "SCORE"},
+    {'o', "option", arg_option, "Set an engine option, e.g. \"LMR=0\"",
+     "NAME=VALUE"},
     {'h', "help", arg_help, "Display usage info", ""},
     {'?', "", arg_help, "Display usage info"},
     {0, "", 0, ""},
@@ -59,6 +97,7 @@ void display_usage(void) {
 int main(int argc, const char *argv[]) {
   debug_init();
   init_board();
+  evaluate_init();
   hash_init();
   tt_init();
   setbuf(stdout, 0);
@@ -71,5 +110,11 @@ int main(int argc, const char *argv[]) {
     return 1;
   }
 
+  printf("Transposition table: %d MB, %llu entries, %d bytes per entry\n",
+         tt_size_mb, tt_n_entries(), tt_entry_size());
+  printf("Pawn hash table: %d MB\n", pawn_hash_mb);
+  printf("PVS: %s, aspiration window: %d\n", pvs_enabled ? "on" : "off",
+         aspiration_window);
+
   return epd_test(filename, depth);
 }
@@ -0,0 +1,239 @@
+/*
+ * Repetition detection benchmarking app
+ * Builds executable bench_history
+ *
+ * Replays a game from a PGN file.  At each position of the game, times the
+ * repetition check used by the search, and a reference check which scans the
+ * whole game history, and prints the time per check and where each first
+ * finds a threefold repetition.
+ */
+
+#include "history.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cmdline.h"
+#include "clock.h"
+#include "evaluate.h"
+#include "hash.h"
+#include "io.h"
+#include "movegen.h"
+#include "position.h"
+
+void display_usage(void);
+
+enum { REPEATS = 100000, MAX_GAME_PLY = 2000, TOKEN_SIZE = 100 };
+
+/*
+ * Variables for program arguments
+ */
+char filename[1000] = "";
+
+/*
+ * Callbacks for program arguments
+ */
+int arg_filename(struct cmdline *cmdl) {
+  strcpy(filename, cmdline_get(cmdl));
+  return 0;
+}
+
+int arg_help(struct cmdline *cmdl) {
+  display_usage();
+  return 1;
+}
+
+/* Table of program arguments */
+const struct cmdline_def arg_defs[] = {
+    {0, "", arg_filename, "Input PGN filename", "FILE"},
+    {'h', "help", arg_help, "Display usage info", ""},
+    {'?', "", arg_help, "Display usage info"},
+    {0, "", 0, ""},
+};
+
+void display_usage(void) {
+  printf("Usage:\n\n     bench_history FILE [OPTIONS]\n\n");
+  cmdline_show(arg_defs);
+  printf("\n");
+}
+
+/* Find the legal move written as `san` in standard algebraic notation.  Return
+ * 0 if there is exactly one. */
+static int parse_san(struct position *position, const char *san,
+                     struct move *move) {
+  char buf[TOKEN_SIZE];
+  int len = 0;
+  for (const char *src = san; *src && len < TOKEN_SIZE - 1; src++)
+    if (!strchr("x+#=!?", *src)) buf[len++] = *src;
+  buf[len] = 0;
+
+  enum piece piece = PAWN, promotion = PAWN;
+  enum square to;
+  int from_file = -1, from_rank = -1;
+  if (strcmp(buf, "O-O") == 0 || strcmp(buf, "O-O-O") == 0) {
+    piece = KING;
+    to = (position->turn == WHITE) ? G1 : G8;
+    if (len == 5) to -= 4;
+  } else {
+    const char *letters = "RNBQK";
+    const char *letter = strchr(letters, buf[0]);
+    int start = 0;
+    if (letter && buf[0]) {
+      piece = ROOK + (enum piece)(letter - letters);
+      start = 1;
+    }
+    const char *promotion_letter = strchr(letters, buf[len - 1]);
+    if (len > 2 && promotion_letter) {
+      promotion = ROOK + (enum piece)(promotion_letter - letters);
+      buf[--len] = 0;
+    }
+    if (len - start < 2 || parse_square(&buf[len - 2], &to)) return 1;
+    for (int i = start; i < len - 2; i++) {
+      if (buf[i] >= 'a' && buf[i] <= 'h') from_file = buf[i] - 'a';
+      if (buf[i] >= '1' && buf[i] <= '8') from_rank = buf[i] - '1';
+    }
+  }
+
+  struct move_list move_buf[N_MOVES];
+  struct move_list *list = move_buf;
+  generate_search_movelist(position, &list);
+  int n_found = 0;
+  for (; list; list = list->next) {
+    struct move *candidate = &list->move;
+    if (candidate->piece != piece || candidate->to != to ||
+        candidate->promotion != promotion)
+      continue;
+    if (from_file >= 0 && candidate->from % 8 != from_file) continue;
+    if (from_rank >= 0 && candidate->from / 8 != from_rank) continue;
+    *move = *candidate;
+    n_found++;
+  }
+  return n_found != 1;
+}
+
+/* Return whether a token of a PGN move list is a move */
+static int is_move_token(const char *token) {
+  if (isdigit(token[0])) return 0; /* Move number or result */
+  if (token[0] == '*' || token[0] == '$') return 0;
+  return 1;
+}
+
+/* Read the moves of the first game in a PGN file, skipping tags, comments and
+ * move numbers.  Return the number of moves, or -1 on error. */
+static int read_pgn(FILE *f, char moves[][TOKEN_SIZE], int max_moves) {
+  int n_moves = 0;
+  int comment = 0;
+  char line[1000];
+  while (fgets(line, sizeof(line), f)) {
+    if (line[0] == '[') continue;
+    for (char *token = strtok(line, " \r\n"); token;
+         token = strtok(0, " \r\n")) {
+      if (comment) {
+        if (strchr(token, '}')) comment = 0;
+        continue;
+      }
+      if (token[0] == '{') {
+        comment = !strchr(token, '}');
+        continue;
+      }
+      /* Move numbers may be joined to the move, as in "1.e4" */
+      char *dot = strrchr(token, '.');
+      if (dot) token = dot + 1;
+      if (!token[0] || !is_move_token(token)) continue;
+      if (n_moves == max_moves) return -1;
+      strncpy(moves[n_moves], token, TOKEN_SIZE - 1);
+      moves[n_moves][TOKEN_SIZE - 1] = 0;
+      n_moves++;
+    }
+  }
+  return n_moves;
+}
+
+/* Reference repetition check - count every second position back through the
+ * whole game history */
+static int reference_repeated(const struct history *history, hash_t hash,
+                              int repetitions) {
+  int count = 0;
+  for (int index = history->index - 2; index >= 0; index -= 2)
+    if (history->hash[index] == hash) count++;
+  return count >= repetitions - 1;
+}
+
+int main(int argc, const char *argv[]) {
+  if (cmdline_parse(arg_defs, argc, argv)) return 1;
+
+  setbuf(stdout, 0);
+  init_board();
+  evaluate_init();
+  hash_init();
+
+  if (!filename[0]) {
+    printf("\nSpecify an input file\n");
+    display_usage();
+    return 1;
+  }
+  FILE *f = fopen(filename, "r");
+  if (!f) {
+    perror(filename);
+    return 1;
+  }
+  static char moves[MAX_GAME_PLY][TOKEN_SIZE];
+  int n_moves = read_pgn(f, moves, MAX_GAME_PLY);
+  fclose(f);
+  if (n_moves < 0) {
+    printf("Too many moves in %s\n", filename);
+    return 1;
+  }
+
+  struct position position;
+  reset_board(&position);
+  struct history history;
+  memset(&history, 0, sizeof(history));
+  struct search_stack stack;
+  stack_init(&stack, &history);
+
+  double total_time = 0.0, total_reference_time = 0.0;
+  int found_at = -1, reference_found_at = -1;
+  int sum = 0;
+  for (int ply = 0; ply <= n_moves; ply++) {
+    double start = time_now();
+    for (int i = 0; i < REPEATS; i++)
+      sum += is_repeated_position(&stack, position.hash, position.halfmove, 3);
+    double time = time_now() - start;
+    start = time_now();
+    for (int i = 0; i < REPEATS; i++)
+      sum += reference_repeated(&history, position.hash, 3);
+    double reference_time = time_now() - start;
+    total_time += time;
+    total_reference_time += reference_time;
+
+    if (found_at < 0 &&
+        is_repeated_position(&stack, position.hash, position.halfmove, 3))
+      found_at = ply;
+    if (reference_found_at < 0 &&
+        reference_repeated(&history, position.hash, 3))
+      reference_found_at = ply;
+
+    if (ply == n_moves) break;
+    struct move move;
+    if (parse_san(&position, moves[ply], &move)) {
+      printf("Can't find move %d %s\n", ply, moves[ply]);
+      return 1;
+    }
+    history_push(&history, position.hash);
+    make_move(&position, &move);
+    change_player(&position);
+  }
+
+  printf("%d positions, %d checks each (%d)\n", n_moves + 1, REPEATS, sum);
+  printf("%-24s %10s %16s\n", "Check", "ns/check", "Threefold at ply");
+  printf("%-24s %10.2lf %16d\n", "Halfmove and filter",
+         total_time * 1e9 / REPEATS / (n_moves + 1), found_at);
+  printf("%-24s %10.2lf %16d\n", "Whole history",
+         total_reference_time * 1e9 / REPEATS / (n_moves + 1),
+         reference_found_at);
+  history_free(&history);
+  return (found_at == reference_found_at) ? 0 : 1;
+}
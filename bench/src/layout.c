@@ -0,0 +1,219 @@
+/*
+ *   Benchmark of the layout of struct position
+ *
+ *   Prints the offset, size and cache line of each field, then times copying
+ *   a position and making and unmaking moves, which are the costs that the
+ *   layout affects.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "clock.h"
+#include "evaluate.h"
+#include "fen.h"
+#include "movegen.h"
+#include "position.h"
+
+/* 10 million */
+const int REPEATS = 10000000;
+const int BUF_LEN = 1000;
+enum { CACHE_LINE_SIZE = 64 };
+
+/* A field of struct position in the layout report */
+struct field {
+  const char *name;
+  size_t offset;
+  size_t size;
+};
+
+#define FIELD_SIZE(name) sizeof(((struct position *)0)->name)
+#define FIELD(name) {#name, offsetof(struct position, name), FIELD_SIZE(name)}
+
+const struct field fields[] = {
+    FIELD(a),
+    FIELD(player_a),
+    FIELD(total_a),
+    FIELD(en_passant),
+    FIELD(hash),
+    FIELD(pawn_hash),
+    FIELD(id),
+    FIELD(next_id),
+    FIELD(piece_square_score),
+    FIELD(material_phase),
+    FIELD(halfmove),
+    FIELD(fullmove),
+    FIELD(ply),
+    FIELD(turn),
+    FIELD(check),
+    FIELD(check_known),
+    FIELD(castling_rights),
+    FIELD(phase),
+    FIELD(piece_square),
+    FIELD(piece_count),
+    FIELD(piece_at),
+    FIELD(index_at),
+    FIELD(moves),
+    FIELD(claim),
+    FIELD(moves_id),
+};
+const int n_fields = sizeof(fields) / sizeof(fields[0]);
+
+/* Print the offset, size and cache lines of each field, in order of offset */
+void print_layout(void) {
+  printf("struct position: %d bytes, %d cache lines\n\n",
+         (int)sizeof(struct position),
+         (int)((sizeof(struct position) + CACHE_LINE_SIZE - 1) /
+               CACHE_LINE_SIZE));
+  printf("%-20s %8s %8s %8s\n", "Field", "Offset", "Size", "Lines");
+  size_t done = 0;
+  for (int n = 0; n < n_fields; n++) {
+    const struct field *next = 0;
+    for (int i = 0; i < n_fields; i++) {
+      if (fields[i].offset < done) continue;
+      if (!next || fields[i].offset < next->offset) next = &fields[i];
+    }
+    size_t first = next->offset / CACHE_LINE_SIZE;
+    size_t last = (next->offset + next->size - 1) / CACHE_LINE_SIZE;
+    printf("%-20s %8d %8d ", next->name, (int)next->offset, (int)next->size);
+    if (first == last)
+      printf("%8d\n", (int)first);
+    else
+      printf("%6d-%d\n", (int)first, (int)last);
+    done = next->offset + 1;
+  }
+  printf("\n");
+}
+
+/* Function to run a test on a position, returns time taken in ns */
+typedef double (*test_func)(struct position *);
+
+/* A test consists of running a function or set of functions */
+struct test {
+  char name[20];     /* Name of test */
+  test_func func;    /* Function to run the test */
+  double total_time; /* Total time taken for all test cases */
+};
+
+/*
+ * Test functions
+ */
+
+/* Time copying the position */
+double time_copy(struct position *position) {
+  struct position copies[2];
+  double start = time_now();
+  for (int i = 0; i < REPEATS; i++) {
+    copy_position(&copies[i & 1], position);
+  }
+  double time = (time_now() - start) * 1e9 / (double)REPEATS;
+  if (copies[0].hash == 1) printf("!");
+  return time;
+}
+
+/* Time making and unmaking each legal move in place, per move */
+double time_make_unmake(struct position *position) {
+  move_t moves[N_MOVES];
+  int n_moves = generate_legal_moves(position, moves);
+  struct move move;
+  struct undo undo;
+  int repeats = REPEATS / 10 / n_moves;
+  double start = time_now();
+  for (int i = 0; i < repeats; i++) {
+    for (int j = 0; j < n_moves; j++) {
+      decode_move(moves[j], &move);
+      make_move_save(position, &move, &undo);
+      change_player(position);
+      unmake_move(position, &undo);
+    }
+  }
+  return (time_now() - start) * 1e9 / (double)(repeats * n_moves);
+}
+
+/* Time copying the position and making each legal move on the copy, per
+ * move */
+double time_copy_make(struct position *position) {
+  move_t moves[N_MOVES];
+  int n_moves = generate_legal_moves(position, moves);
+  struct position next;
+  struct move move;
+  int repeats = REPEATS / 10 / n_moves;
+  double start = time_now();
+  for (int i = 0; i < repeats; i++) {
+    for (int j = 0; j < n_moves; j++) {
+      copy_position(&next, position);
+      decode_move(moves[j], &move);
+      make_move(&next, &move);
+      change_player(&next);
+    }
+  }
+  double time = (time_now() - start) * 1e9 / (double)(repeats * n_moves);
+  if (next.hash == 1) printf("!");
+  return time;
+}
+
+/* Tests */
+struct test tests[] = {
+    {"copy", time_copy, 0.0},
+    {"make_unmake", time_make_unmake, 0.0},
+    {"copy_make", time_copy_make, 0.0},
+};
+const int n_tests = sizeof(tests) / sizeof(tests[0]);
+
+/* Test cases */
+const char test_case_fen[][100] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w",
+    "1b1qrr2/1p4pk/1np4p/p3Np1B/Pn1P4/R1N3B1/1Pb2PPP/2Q1R1K1 b",
+    "1k1r2r1/1b4p1/p4n1p/1pq1pPn1/2p1P3/P1N2N2/1PB1Q1PP/3R1R1K b",
+    "1k1r4/4bp2/p1q1pnr1/6B1/NppP3P/6P1/1P3P2/2RQR1K1 w",
+    "1n1rr1k1/1pq2pp1/3b2p1/2p3N1/P1P5/P3B2P/2Q2PP1/R2R2K1 w",
+    "1r6/8/p2b3p/2nN1kpP/2P1p3/3rP3/3NKP2/1R1R4 w",
+};
+const int n_test_cases = sizeof(test_case_fen) / sizeof(test_case_fen[0]);
+
+/* Run all tests for a single test case */
+void run_case(const char *fen) {
+  char buf[BUF_LEN];
+  strcpy(buf, fen);
+  const char *pieces = strtok(buf, " ");
+  const char *turn = strtok(0, "");
+  struct position position;
+  load_fen(&position, pieces, turn, "-", "-", "1", "1");
+  printf("%-60s ", fen);
+  fflush(stdout);
+
+  for (int i = 0; i < n_tests; i++) {
+    double time = (tests[i].func)(&position);
+    tests[i].total_time += time;
+    printf("%-15.1lf ", time);
+    fflush(stdout);
+  }
+  printf("\n");
+}
+
+/* Run all test cases */
+int main(int argc, char *argv[]) {
+  init_board();
+  evaluate_init();
+  print_layout();
+  printf("%-60s %s\n", "Test position", "Time, ns");
+  printf("%-60s ", "");
+
+  for (int i = 0; i < n_tests; i++) {
+    printf("%-15s ", tests[i].name);
+  }
+  printf("\n");
+
+  for (int i = 0; i < n_test_cases; i++) {
+    run_case(test_case_fen[i]);
+  }
+
+  printf("%-60s ", "Mean");
+  for (int i = 0; i < n_tests; i++) {
+    printf("%-15.1lf ", tests[i].total_time / (double)n_test_cases);
+  }
+  printf("\n");
+
+  return 0;
+}
@@ -2,6 +2,7 @@
 
 #include "clock.h"
 #include "fen.h"
+#include "movegen.h"
 #include "position.h"
 
 /* 10 million */
@@ -13,7 +14,7 @@ struct total {
   double king_attacks;
 };
 
-/* Function to run a test on a position, returns time taken in ms */
+/* Function to run a test on a position, returns time taken in ns */
 typedef double (*test_func)(struct position *);
 
 /* A test consists of running a function or set of functions */
@@ -31,7 +32,7 @@ double time_calculate_moves(struct position *position) {
   for (int i = 0; i < REPEATS; i++) {
     calculate_moves(position);
   }
-  return (time_now() - start) * 1000.0 / (double)REPEATS;
+  return (time_now() - start) * 1e9 / (double)REPEATS;
 }
 
 double time_king_attacks(struct position *position) {
@@ -43,13 +44,104 @@ double time_king_attacks(struct position *position) {
       get_attacks(position, square, !player);
     }
   }
-  return (time_now() - start) * 1000.0 / (double)REPEATS;
+  return (time_now() - start) * 1e9 / (double)REPEATS;
+}
+
+/* Time lookups of rook and bishop attacks from every occupied square, through
+ * the compiled slider backend */
+double time_sliders(struct position *position) {
+  bitboard_t sum = 0;
+  double start = time_now();
+  for (int i = 0; i < REPEATS; i++) {
+    bitboard_t pieces = position->total_a;
+    while (pieces) {
+      enum square square = bit2square(take_next_bit_from(&pieces));
+      sum ^= rook_attacks(square, position->total_a) ^
+             bishop_attacks(square, position->total_a);
+    }
+  }
+  double time = (time_now() - start) * 1e9 / (double)REPEATS;
+  if (sum == 1) printf("!");
+  return time;
+}
+
+/* The same as `time_sliders` using ray walking instead of lookups, as a
+ * reference */
+double time_slide_walk(struct position *position) {
+  bitboard_t sum = 0;
+  double start = time_now();
+  for (int i = 0; i < REPEATS / 10; i++) {
+    bitboard_t pieces = position->total_a;
+    while (pieces) {
+      enum square square = bit2square(take_next_bit_from(&pieces));
+      sum ^= slide_attacks(square, position->total_a, 0) ^
+             slide_attacks(square, position->total_a, 1);
+    }
+  }
+  double time = (time_now() - start) * 1e9 / (double)(REPEATS / 10);
+  if (sum == 1) printf("!");
+  return time;
+}
+
+/* Time generating the sorted list of all moves for the side to move */
+double time_movelist(struct position *position) {
+  struct move_list move_buf[N_MOVES];
+  double start = time_now();
+  for (int i = 0; i < REPEATS / 10; i++) {
+    struct move_list *head = move_buf;
+    generate_search_movelist(position, &head);
+  }
+  return (time_now() - start) * 1e9 / (double)(REPEATS / 10);
+}
+
+/* Time picking all moves for the side to move with the staged move picker */
+double time_picker_all(struct position *position) {
+  struct move_picker picker;
+  double start = time_now();
+  for (int i = 0; i < REPEATS / 10; i++) {
+    picker_init(&picker, position, 0, 0, 0, 0, 0);
+    while (picker_next(&picker)) {
+    }
+  }
+  return (time_now() - start) * 1e9 / (double)(REPEATS / 10);
+}
+
+/* Time picking the first move only, which is all that is needed when it causes
+ * a cutoff */
+double time_picker_first(struct position *position) {
+  struct move_picker picker;
+  double start = time_now();
+  for (int i = 0; i < REPEATS / 10; i++) {
+    picker_init(&picker, position, 0, 0, 0, 0, 0);
+    picker_next(&picker);
+  }
+  return (time_now() - start) * 1e9 / (double)(REPEATS / 10);
+}
+
+/* Time static evaluation alone, as at a leaf node where the moves have not
+ * been calculated */
+double time_evaluate(struct position *position) {
+  score_t sum = 0;
+  double start = time_now();
+  for (int i = 0; i < REPEATS / 10; i++) {
+    position->moves_id = 0;
+    sum += evaluate(position, 0);
+  }
+  double time = (time_now() - start) * 1e9 / (double)(REPEATS / 10);
+  if (sum == 1) printf("!");
+  return time;
 }
 
 /* Tests */
 struct test tests[] = {
     {"calc_moves", time_calculate_moves, 0.0},
     {"king_attacks", time_king_attacks, 0.0},
+    {"sliders", time_sliders, 0.0},
+    {"slide_walk", time_slide_walk, 0.0},
+    {"movelist", time_movelist, 0.0},
+    {"picker_all", time_picker_all, 0.0},
+    {"picker_first", time_picker_first, 0.0},
+    {"evaluate", time_evaluate, 0.0},
 };
 const int n_tests = sizeof(tests) / sizeof(tests[0]);
 
@@ -86,7 +178,7 @@ void run_case(const char *fen) {
   for (int i = 0; i < n_tests; i++) {
     double time = (tests[i].func)(&position);
     tests[i].total_time += time;
-    printf("%-15lf ", time);
+    printf("%-15.1lf ", time);
     fflush(stdout);
   }
   printf("\n");
@@ -95,7 +187,9 @@ void run_case(const char *fen) {
 /* Run all test cases */
 int main(int argc, char *argv[]) {
   init_board();
-  printf("%-60s %s\n", "Test position", "Time, ms");
+  evaluate_init();
+  printf("Slider backend: %s\n", slider_backend);
+  printf("%-60s %s\n", "Test position", "Time, ns");
   printf("%-60s ", "");
 
   for (int i = 0; i < n_tests; i++) {
@@ -109,13 +203,13 @@ int main(int argc, char *argv[]) {
 
   printf("%-60s ", "Total");
   for (int i = 0; i < n_tests; i++) {
-    printf("%-15lf ", tests[i].total_time);
+    printf("%-15.1lf ", tests[i].total_time);
   }
   printf("\n");
 
   printf("%-60s ", "Mean");
   for (int i = 0; i < n_tests; i++) {
-    printf("%-15lf ", tests[i].total_time / (double)n_test_cases);
+    printf("%-15.1lf ", tests[i].total_time / (double)n_test_cases);
   }
   printf("\n");
 
@@ -3,6 +3,10 @@
  * Builds executable bench_search
  *
  * Plays AI-AI games at increasing depths and prints moves and statistics.
+ * With `--clear-hash`, the transposition table is cleared before every move,
+ * to compare with keeping the results of earlier searches.
+ * With `--threads N`, instead measures nodes/sec scaling of the Lazy SMP
+ * search from 1 to N threads.
  */
 
 #include "search.h"
@@ -10,14 +14,76 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "cmdline.h"
+#include "evaluate.h"
 #include "fen.h"
-#include "hash.c"
+#include "hash.h"
 #include "history.h"
 #include "io.h"
+#include "os.h"
 #include "position.h"
 
+void display_usage(void);
+
+/*
+ * Variables for program arguments
+ */
 int max_depth = 8;
 int ply = 50;
+int max_threads = 0;
+int clear_hash = 0;
+
+/*
+ * Callbacks for program arguments
+ */
+int arg_depth(struct cmdline *cmdl) {
+  const char *arg = cmdline_get(cmdl);
+  if (!arg || sscanf(arg, "%d", &max_depth) != 1) return 1;
+  return 0;
+}
+
+int arg_threads(struct cmdline *cmdl) {
+  const char *arg = cmdline_get(cmdl);
+  if (!arg || sscanf(arg, "%d", &max_threads) != 1) return 1;
+  if (max_threads < 1 || max_threads > MAX_THREADS) return 1;
+  return 0;
+}
+
+int arg_clear_hash(struct cmdline *cmdl) {
+  clear_hash = 1;
+  return 0;
+}
+
+int arg_help(struct cmdline *cmdl) {
+  display_usage();
+  return 1;
+}
+
+/* Table of program arguments */
+const struct cmdline_def arg_defs[] = {
+    {0, "", arg_depth, "Maximum search depth", "N"},
+    {'t', "threads", arg_threads, "Measure scaling from 1 to N threads", "N"},
+    {'c', "clear-hash", arg_clear_hash, "Clear the hash table before each move",
+     ""},
+    {'h', "help", arg_help, "Display usage info", ""},
+    {'?', "", arg_help, "Display usage info"},
+    {0, "", 0, ""},
+};
+
+void display_usage(void) {
+  printf("Usage:\n\n     bench_search [DEPTH] [OPTIONS]\n\n");
+  cmdline_show(arg_defs);
+  printf("\n");
+}
+
+/* Positions searched to measure thread scaling */
+const char scaling_fen[][100] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "1k1r4/1br2p2/3p1p2/pp2pPb1/2q1P2p/P1PQNB1P/1P4P1/1K1RR3 b - - 0 1",
+    "1n1rr1k1/1pq2pp1/3b2p1/2p3N1/P1P5/P3B2P/2Q2PP1/R2R2K1 w - - 0 1",
+};
+const int n_scaling_fen = sizeof(scaling_fen) / sizeof(scaling_fen[0]);
 
 void bench_search(int depth) {
   struct position position;
@@ -26,12 +92,13 @@ void bench_search(int depth) {
   struct history history;
   memset(&history, 0, sizeof(history));
 
-  clock_t total = 0;
+  double total = 0.0;
   long long n_searched = 0;
 
   for (int i = 0; i < ply; i++) {
     struct search_result res;
 
+    if (clear_hash) tt_clear();
     search(depth, 0.0, 0.0, &history, &position, &res, 1);
     total += res.time;
     n_searched += res.n_leaf;
@@ -43,34 +110,74 @@ void bench_search(int depth) {
 
     printf("move %2d %4d %-70s %8s\n", depth, i, fen, move);
     printf("stat %2d %4d %-70s %8s %10d %4.2lf %16lld %6.2lf\n", depth, i, fen,
-           move, res.n_leaf, (double)res.time / 1000000.0, n_searched,
-           (double)total / 1000000.0);
+           move, res.n_leaf, res.time, n_searched, total);
 
     if (res.move.from == A1 && res.move.to == A1) break;
 
+    history_push(&history, position.hash);
     make_move(&position, &res.move);
-    history_push(&history, position.hash, &res.move);
     change_player(&position);
   }
 
   printf("avg  %4d %4d %16lld %6.2lf\n", depth, ply, n_searched / ply,
-         (double)total / ((double)ply * 1000000.0));
+         total / (double)ply);
+  history_free(&history);
 }
 
-int main(int argc, const char *argv[]) {
-  if (argc == 2) {
-    printf("%s\n", argv[1]);
-    if (sscanf(argv[1], "%d", &max_depth) != 1) {
-      return 1;
+/* Search each of `scaling_fen` to `depth` with 1 to `threads` threads and print
+ * the node rate compared to a single thread. */
+void bench_threads(int depth, int threads) {
+  printf("%8s %16s %10s %12s %10s\n", "Threads", "Nodes", "Time (s)",
+         "knps", "Scaling");
+  double base_nps = 0.0;
+  for (int n = 1; n <= threads; n++) {
+    search_threads = n;
+    long long nodes = 0;
+    double time = 0.0;
+    for (int i = 0; i < n_scaling_fen; i++) {
+      char buf[100];
+      strcpy(buf, scaling_fen[i]);
+      const char *placement = strtok(buf, " ");
+      const char *active = strtok(0, " ");
+      const char *castling = strtok(0, " ");
+      const char *en_passant = strtok(0, " ");
+      const char *halfmove = strtok(0, " ");
+      const char *fullmove = strtok(0, " ");
+      struct position position;
+      load_fen(&position, placement, active, castling, en_passant, halfmove,
+               fullmove);
+      struct history history;
+      memset(&history, 0, sizeof(history));
+      tt_clear();
+
+      struct search_result res;
+      double start = time_now();
+      search(depth, 0.0, 0.0, &history, &position, &res, 0);
+      time += time_now() - start;
+      nodes += res.n_node;
     }
+    double nps = (double)nodes / time;
+    if (n == 1) base_nps = nps;
+    printf("%8d %16lld %10.2lf %12.0lf %9.2lfx\n", n, nodes, time,
+           nps / 1000.0, nps / base_nps);
   }
+}
+
+int main(int argc, const char *argv[]) {
+  if (cmdline_parse(arg_defs, argc, argv)) return 1;
 
   setbuf(stdout, 0);
   init_board();
+  evaluate_init();
   hash_init();
   debug_init();
   tt_init();
 
+  if (max_threads) {
+    bench_threads(max_depth, max_threads);
+    return 0;
+  }
+
   for (int i = 1; i <= max_depth; i++) {
     bench_search(i);
   }
@@ -95,15 +95,12 @@ static inline double clock_get_time_budget(struct clock *clock,
           clock->time_remaining[turn] / (double)clock->moves_remaining[turn];
       time_budget = fmax(time_budget, target_average_time / 3.0);
       time_budget = fmin(time_budget, target_average_time * 3.0);
-      printf("cl tc %lf mps %d tr %lf mr %d stb %lf\n", clock->time_control,
-             clock->moves_per_session, clock->time_remaining[turn],
-             clock->moves_remaining[turn], time_budget);
-
       return time_budget;
     }
     case TIME_CTRL_INCREMENTAL:
       return fmin(clock->time_remaining[turn],
-                  clock->time_control / 40.0 + clock->time_remaining[turn]);
+                  clock->time_remaining[turn] / 40.0 +
+                      clock->increment_seconds);
     case TIME_CTRL_FIXED:
     default:
       return clock->increment_seconds;
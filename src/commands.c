@@ -7,17 +7,23 @@
 #include "debug.h"
 #include "engine.h"
 #include "fen.h"
+#include "hash.h"
 #include "info.h"
 #include "io.h"
 #include "movegen.h"
 #include "options.h"
+#include "perft.h"
 #include "search.h"
+#include "uci.h"
 #include "ui.h"
 
 /* --- Commands */
 
 /* -- Game Control */
 
+/* Permanently switch to UCI mode, until the program quits */
+static void ui_uci(struct engine *e) { run_uci(e); }
+
 /* Permanently switch to XBoard mode */
 static void ui_xboard(struct engine *e) { enter_xboard_mode(e); }
 
@@ -32,6 +38,14 @@ static void ui_force(struct engine *e) { e->mode = ENGINE_FORCE_MODE; }
  * turn */
 static void ui_go(struct engine *e) { e->mode = e->game.turn; }
 
+/* Analyse the position without a time limit until "exit" */
+static void ui_analyze(struct engine *e) { e->mode = ENGINE_ANALYSE_MODE; }
+
+/* Leave analyse mode */
+static void ui_exit(struct engine *e) {
+  if (e->mode == ENGINE_ANALYSE_MODE) e->mode = ENGINE_FORCE_MODE;
+}
+
 /* Tell this AI that it is playing another AI - not implemented */
 static void ui_computer(struct engine *e) {}
 
@@ -77,6 +91,32 @@ static void ui_sd(struct engine *e) {
   sscanf(get_input(), "%d", &e->search_depth);
 }
 
+/* Number of threads to search with */
+static void ui_cores(struct engine *e) {
+  int cores;
+  if (sscanf(get_input(), "%d", &cores) != 1) return;
+  if (cores < 1) cores = 1;
+  if (cores > MAX_THREADS) cores = MAX_THREADS;
+  search_threads = cores;
+}
+
+/* Think on the opponent's time */
+static void ui_hard(struct engine *e) { e->ponder = 1; }
+
+/* Don't think on the opponent's time */
+static void ui_easy(struct engine *e) {
+  e->ponder = 0;
+  e->ponder_hash = 0;
+}
+
+/* Hash table memory in MB */
+static void ui_memory(struct engine *e) {
+  int memory;
+  if (sscanf(get_input(), "%d", &memory) != 1) return;
+  if (memory < 1) memory = 1;
+  tt_size_mb = memory;
+}
+
 static int ui_parse_time(const char *txt, int *time) {
   char time_txt[20];
   strncpy(time_txt, txt, sizeof(time_txt) - 1);
@@ -235,7 +275,9 @@ static void ui_moves(struct engine *e) {
 }
 
 /* Evaluate the position and print the score */
-static void ui_eval(struct engine *e) { printf("%d\n", evaluate(&(e->game))); }
+static void ui_eval(struct engine *e) {
+  printf("%d\n", evaluate(&(e->game), 0));
+}
 
 /* Run perft to a specified depth */
 static void ui_perft(struct engine *e) {
@@ -258,6 +300,9 @@ static void ui_perftd(struct engine *e) {
 /* Print program info */
 static void ui_info(struct engine *e) { print_program_info(); }
 
+/* Display the statistics of the last search */
+static void ui_stats(struct engine *e) { print_search_stats(&e->last_result); }
+
 /* No Operation */
 static void ui_noop(struct engine *e) {}
 static void ui_noop_1arg(struct engine *e) { get_input(); }
@@ -283,19 +328,26 @@ static void ui_help(struct engine *e);
 const struct command cmds[] = {
     /* clang-format off */
   { CT_DISPLAY, "allmoves", ui_allmoves,   "     - Print a list of all possible moves" },
+  { CT_GAMECTL, "analyse",  ui_analyze,    "     - Analyse the position without a time limit until 'exit'" },
+  { CT_XBOARD,  "analyze",  ui_analyze,    "     - Analyse the position without a time limit until 'exit'" },
   { CT_DISPLAY, "attacks",  ui_attacks,    "POS  - Display all pieces that can attack POS" },
   { CT_XBOARD,  "accepted", ui_accepted,   "     - ???" },
   { CT_UNIMP,   "black",    ui_noop,       "     - This function is accepted but currently has no effect" },
   { CT_XBOARD,  "computer", ui_computer,   "     - ???" },
+  { CT_GAMECTL, "cores",    ui_cores,      "N    - Set the number of search threads" },
+  { CT_GAMECTL, "easy",     ui_easy,       "     - Turn off pondering" },
   { CT_DISPLAY, "eval",     ui_eval,       "     - Evaluate game" },
+  { CT_GAMECTL, "exit",     ui_exit,       "     - Leave analyse mode" },
   { CT_GAMECTL, "fen",      ui_fen,        "FEN  - Set the position using a FEN string" },
   { CT_GAMECTL, "force",    ui_force,      "     - Enter force mode" },
   { CT_GAMECTL, "getfen",   ui_getfen,     "     - Get the position in FEN notation" },
   { CT_DISPLAY, "gitinfo",  ui_gitinfo,    "     - Show git info" },
   { CT_GAMECTL, "go",       ui_go,         "     - AI to make first move if playing as white" },
+  { CT_GAMECTL, "hard",     ui_hard,       "     - Turn on pondering - think on the opponent's time" },
   { CT_GAMECTL, "help",     ui_help,       "     - Display a list of all commands" },
   { CT_DISPLAY, "info",     ui_info,       "     - Display build information"},
   { CT_GAMECTL, "level",    ui_level,      "MPS BASE INC - Set time control settings"},
+  { CT_GAMECTL, "memory",   ui_memory,     "MB   - Set the hash table size" },
   { CT_DISPLAY, "moves",    ui_moves,      "POS  - Display all squares that the piece at POS can move to" },
   { CT_GAMECTL, "new",      ui_new,        "     - New game" },
   { CT_XBOARD,  "offer",    ui_offer_draw, "     - Offer a draw by agreement, or accept an offer" },
@@ -308,11 +360,13 @@ const struct command cmds[] = {
   { CT_GAMECTL, "quit",     ui_quit,       "     - Quit the program" },
   { CT_GAMECTL, "q",        ui_quit,       "     - Quit the program more quickly" },
   { CT_GAMECTL, "setboard", ui_fen,        "FEN  - Set the position using a FEN string" },
+  { CT_DISPLAY, "stats",    ui_stats,      "     - Display statistics of the last search" },
   { CT_GAMECTL, "st",       ui_st,         "     - Set the time control period" },
   { CT_GAMECTL, "sd",       ui_sd,         "D    - Set the search depth" },
   { CT_UNIMP,   "time",     ui_time,       "MS   - Advise the current player's remaining time" },
   { CT_UNIMP,   "random",   ui_noop,       "     - This function is accepted but currently has no effect" },
   { CT_UNIMP,   "result",   ui_result,     "     - This function is accepted but currently has no effect" },
+  { CT_GAMECTL, "uci",      ui_uci,        "     - Enter UCI mode" },
   { CT_UNIMP,   "undo",     ui_noop,       "     - This function is accepted but currently has no effect" },
   { CT_UNIMP,   "variant",  ui_noop_1arg,  "     - This function is accepted but currently has no effect" },
   { CT_UNIMP,   "white",    ui_noop,       "     - This function is accepted but currently has no effect" },
@@ -83,7 +83,7 @@ void assert_fail(const char *src_file, const char *func, const int line,
 
 /* Print alpha, beta, search history to logfile or stdout */
 void debug_thought(const struct search_job *job, const struct pv *pv,
-                   struct move *move, int depth, score_t score, score_t alpha,
+                   move_t move, int depth, score_t score, score_t alpha,
                    score_t beta, hash_t hash) {
   fprintf(logfile, "%2d %10d ", depth, job->result.n_leaf);
   if (alpha > -100000)
@@ -96,8 +96,10 @@ void debug_thought(const struct search_job *job, const struct pv *pv,
     fprintf(logfile, "     +B ");
   fprintf(logfile, "  %016llx ", hash);
   char move_buf[10];
-  format_move(move_buf, move, sizeof(move_buf));
+  struct move unpacked;
+  decode_move(move, &unpacked);
+  format_move(move_buf, &unpacked, sizeof(move_buf));
   fprintf(logfile, " %s ", move_buf);
-  print_pv(logfile, pv);
+  print_pv(logfile, 0, pv);
   fprintf(logfile, "\n");
 }
@@ -10,6 +10,10 @@
 
 void debug_init();
 
+/* Compile-time assertion, for C99 which has no `_Static_assert`.  `name` is
+ * used in the error message if it fails. */
+#define STATIC_ASSERT(name, x) typedef char static_assert_##name[(x) ? 1 : -1]
+
 #ifdef ASSERTS
 
 void assert_fail(const char *file, const char *func, const int line,
@@ -29,11 +33,10 @@ void assert_fail(const char *file, const char *func, const int line,
 
 struct search_job;
 struct pv;
-struct move;
 
 void debug_thought(const struct search_job *job, const struct pv *pv,
-                   struct move *move, int depth, int score, int alpha, int beta,
-                   unsigned long long hash);
+                   unsigned short move, int depth, int score, int alpha,
+                   int beta, unsigned long long hash);
 
 void debug_print(const char *fmt, ...);
 #else
@@ -33,6 +33,14 @@ struct engine {
   struct history history;
   struct clock clock;
   int search_depth;
+
+  /* Pondering - searching the expected reply on the opponent's time.  The
+   * result is used if the opponent plays it. */
+  int ponder;
+  struct search_result ponder_result;
+  hash_t ponder_hash; /* Position `ponder_result` is for, or 0 */
+
+  struct search_result last_result; /* Of the last search, for `stats` */
 };
 
 #endif /* ENGINE_H */
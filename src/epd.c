@@ -84,24 +84,106 @@ static double get_n_leaf(const struct search_result *r) {
 static double get_n_node(const struct search_result *r) {
   return (double)r->n_node / 1000.0;
 }
-static double get_n_check_node(const struct search_result *r) {
-  return (double)r->n_check_moves / 1000.0;
-}
-static double get_r_check_node(const struct search_result *r) {
-  return (double)r->n_check_moves / (double)r->n_node;
-}
 static double get_branching_factor(const struct search_result *r) {
   return r->branching_factor;
 }
 static double get_time(const struct search_result *r) { return r->time; }
+static double get_knps(const struct search_result *r) {
+  return r->time > 0.0 ? (double)r->n_node / r->time / 1000.0 : 0.0;
+}
+static double get_r_tt_hit(const struct search_result *r) {
+  return r->tt_probes ? (double)r->tt_hits / (double)r->tt_probes : 0.0;
+}
+static double get_r_moves_avoided(const struct search_result *r) {
+  long long total = r->n_moves_generated + r->n_moves_avoided;
+  return total ? (double)r->n_moves_avoided / (double)total : 0.0;
+}
+static double get_r_pawn_hit(const struct search_result *r) {
+  return r->pawn_hash_probes
+             ? (double)r->pawn_hash_hits / (double)r->pawn_hash_probes
+             : 0.0;
+}
+
+static double get_n_pvs_research(const struct search_result *r) {
+  return (double)r->n_pvs_researches;
+}
+static double get_n_asp_research(const struct search_result *r) {
+  return (double)r->n_aspiration_researches;
+}
+
+static double get_n_null_cut(const struct search_result *r) {
+  return (double)r->prune[PRUNE_NULL_MOVE].cutoffs / 1000.0;
+}
+static double get_r_null_cut(const struct search_result *r) {
+  const struct prune_stats *p = &r->prune[PRUNE_NULL_MOVE];
+  return p->attempts ? (double)p->cutoffs / (double)p->attempts : 0.0;
+}
+static double get_n_lmr(const struct search_result *r) {
+  return (double)r->prune[PRUNE_LMR].attempts / 1000.0;
+}
+static double get_r_lmr_research(const struct search_result *r) {
+  const struct prune_stats *p = &r->prune[PRUNE_LMR];
+  return p->attempts ? (double)p->researches / (double)p->attempts : 0.0;
+}
+static double get_n_futile(const struct search_result *r) {
+  return (double)r->prune[PRUNE_FUTILITY].cutoffs / 1000.0;
+}
+static double get_n_razor_cut(const struct search_result *r) {
+  return (double)r->prune[PRUNE_RAZORING].cutoffs / 1000.0;
+}
+
+static double get_r_first_cut(const struct search_result *r) {
+  return r->n_cutoffs ? (double)r->n_first_move_cutoffs / (double)r->n_cutoffs
+                      : 0.0;
+}
+
+/* Detailed statistics, which are zero unless built with SEARCH_STATS */
+static long long get_n_full_width(const struct search_result *r) {
+  return r->stats.pv_nodes + r->stats.cut_nodes + r->stats.all_nodes;
+}
+static double get_r_pv_node(const struct search_result *r) {
+  long long total = get_n_full_width(r);
+  return total ? (double)r->stats.pv_nodes / (double)total : 0.0;
+}
+static double get_r_cut_node(const struct search_result *r) {
+  long long total = get_n_full_width(r);
+  return total ? (double)r->stats.cut_nodes / (double)total : 0.0;
+}
+static double get_r_all_node(const struct search_result *r) {
+  long long total = get_n_full_width(r);
+  return total ? (double)r->stats.all_nodes / (double)total : 0.0;
+}
+static double get_r_quiescence_node(const struct search_result *r) {
+  return r->n_node ? (double)r->stats.quiescence_nodes / (double)r->n_node
+                   : 0.0;
+}
+static double get_r_tt_cut(const struct search_result *r) {
+  return r->tt_hits ? (double)r->stats.tt_cutoffs / (double)r->tt_hits : 0.0;
+}
 
 const struct epd_var vars[] = {
     {"time (s)", "%16.2lf", get_time},
     {"branching factor", "%16.2lf", get_branching_factor},
     {"n_leaf (k)", "%16.0lf", get_n_leaf},
     {"n_node (k)", "%16.0lf", get_n_node},
-    {"n_check_node (k)", "%16.0lf", get_n_check_node},
-    {"r_check_node", "%16.2lf", get_r_check_node},
+    {"knps", "%16.0lf", get_knps},
+    {"r_tt_hit", "%16.2lf", get_r_tt_hit},
+    {"r_moves_avoided", "%16.2lf", get_r_moves_avoided},
+    {"r_pawn_hit", "%16.2lf", get_r_pawn_hit},
+    {"n_pvs_research", "%16.0lf", get_n_pvs_research},
+    {"n_asp_research", "%16.0lf", get_n_asp_research},
+    {"n_null_cut (k)", "%16.0lf", get_n_null_cut},
+    {"r_null_cut", "%16.2lf", get_r_null_cut},
+    {"n_lmr (k)", "%16.0lf", get_n_lmr},
+    {"r_lmr_research", "%16.2lf", get_r_lmr_research},
+    {"n_futile (k)", "%16.0lf", get_n_futile},
+    {"n_razor_cut (k)", "%16.0lf", get_n_razor_cut},
+    {"r_first_cut", "%16.2lf", get_r_first_cut},
+    {"r_pv_node", "%16.2lf", get_r_pv_node},
+    {"r_cut_node", "%16.2lf", get_r_cut_node},
+    {"r_all_node", "%16.2lf", get_r_all_node},
+    {"r_quiescence_node", "%16.2lf", get_r_quiescence_node},
+    {"r_tt_cut", "%16.2lf", get_r_tt_cut},
 };
 const int n_vars = sizeof(vars) / sizeof(vars[0]);
 
@@ -373,11 +455,6 @@ int epd_test(const char *filename, int depth) {
   if (id_set == 0) return 1;
   for (int i = 0; i < n_tests; i++) id_set[i] = -1;
 
-  if (show_stats) {
-    stats = (struct epd_stat *)calloc(n_sets * n_vars, sizeof(struct epd_stat));
-    if (stats == 0) return 1;
-  }
-
   int index = 0;
   int n_pass = 0;
   int id = 0;
@@ -410,6 +487,9 @@ int epd_test(const char *filename, int depth) {
   }
 
   if (show_stats) {
+    /* The number of sets is only known once all cases have run */
+    stats = (struct epd_stat *)calloc(n_sets * n_vars, sizeof(struct epd_stat));
+    if (stats == 0) return 1;
     for (int i = 0; i < n_tests; i++) {
       int set_id = id_set[i];
       if (set_id == -1) continue;
@@ -472,8 +552,6 @@ int epd_test(const char *filename, int depth) {
         }
         printf("\n");
       }
-      printf("Avg. r_check_node %0.2lf\n",
-             stats[i * n_vars + 1].total / stats[i * n_vars + 0].total);
       printf("\n");
     }
 
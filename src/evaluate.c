@@ -8,11 +8,17 @@
 #include "evaluate.h"
 
 #include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "debug.h"
+#include "hash.h"
+#include "moves.h"
 #include "options.h"
 #include "position.h"
+#include "search.h"
 
 /* Front spans - used for passed pawn evaluation.  The set of squares in front
  * of a pawn that must not be blocked by, or under attack from, an opponent's
@@ -43,14 +49,25 @@ int passed_pawn_advance_bonus = 50;
 /* Small random value 0-9 */
 int randomness = 0;
 
-/* The threshold for the sum of black and white's material to indicate the
- * endgame phase */
+/* The threshold for the sum of black and white's material, not counting the
+ * kings, below which the game is in the endgame phase */
 int endgame_material = 6000;
 
 /* Penalties for opening up with Queen early */
 int unmoved_penalty = 400;
 int queen_penalty = 800;
 
+/* Size of the pawn hash table in MB, zero to disable it */
+int pawn_hash_mb = PAWN_HASH_DEFAULT_MB;
+
+/* Scale of the middlegame and endgame piece-square tables, in percent */
+int piece_square_scale[N_TAPER] = {100, 100};
+
+/* File to load the piece-square tables from - see `load_piece_square` */
+char piece_square_file[1024] = "";
+
+static void load_piece_square(struct engine *engine);
+
 /* Evaluation user options. */
 const struct option _eval_opts[] = {
     /* clang-format off */
@@ -69,61 +86,406 @@ const struct option _eval_opts[] = {
   { "Opening queen move penalty",    INT_OPT, .value.integer = &queen_penalty,   0, 0, 0 },
 #endif
   { "Endgame material threshold",    INT_OPT, .value.integer = &endgame_material, 0, 0, 0 },
+  { "Pawn hash",             SPIN_OPT, .value.integer = &pawn_hash_mb, 0, PAWN_HASH_MAX_MB, 0 },
+  { "Piece-square middlegame %", SPIN_OPT, .value.integer = &piece_square_scale[TAPER_MG], 0, 400, 0 },
+  { "Piece-square endgame %",    SPIN_OPT, .value.integer = &piece_square_scale[TAPER_EG], 0, 400, 0 },
+  { "Piece-square file",     TEXT_OPT, .value.text = piece_square_file,      0, 0, 0 },
+  { "Load piece-square file", CMD_OPT, .value.function = load_piece_square,  0, 0, 0 },
     /* clang-format on */
 };
 const struct options eval_opts = {sizeof(_eval_opts) / sizeof(_eval_opts[0]),
                                   _eval_opts};
 
+/*
+ *  Piece-square tables
+ *
+ *  A bonus or penalty for each type of piece on each square, with separate
+ *  values for the middlegame and the endgame.  The score of a position is
+ *  tapered between the two by `position->material_phase`, so that it changes
+ *  smoothly as pieces are exchanged.  The tables are laid out as seen from
+ *  white's side of the board, rank 8 first, and black's are mirrored.
+ */
+
+/* Base tables, which may be replaced from a file by `load_piece_square` */
+score_t piece_square_base[N_TAPER][N_PIECE_T][N_SQUARES] = {
+    /* clang-format off */
+    {
+        /* Middlegame */
+        {
+            /* Pawn */
+              0,   0,   0,   0,   0,   0,   0,   0,
+             50,  50,  50,  50,  50,  50,  50,  50,
+             10,  10,  20,  30,  30,  20,  10,  10,
+              5,   5,  10,  25,  25,  10,   5,   5,
+              0,   0,   0,  20,  20,   0,   0,   0,
+              5,  -5, -10,   0,   0, -10,  -5,   5,
+              5,  10,  10, -20, -20,  10,  10,   5,
+              0,   0,   0,   0,   0,   0,   0,   0,
+        },
+        {
+            /* Rook */
+              0,   0,   0,   0,   0,   0,   0,   0,
+              5,  10,  10,  10,  10,  10,  10,   5,
+             -5,   0,   0,   0,   0,   0,   0,  -5,
+             -5,   0,   0,   0,   0,   0,   0,  -5,
+             -5,   0,   0,   0,   0,   0,   0,  -5,
+             -5,   0,   0,   0,   0,   0,   0,  -5,
+             -5,   0,   0,   0,   0,   0,   0,  -5,
+              0,   0,   0,   5,   5,   0,   0,   0,
+        },
+        {
+            /* Knight */
+            -50, -40, -30, -30, -30, -30, -40, -50,
+            -40, -20,   0,   0,   0,   0, -20, -40,
+            -30,   0,  10,  15,  15,  10,   0, -30,
+            -30,   5,  15,  20,  20,  15,   5, -30,
+            -30,   0,  15,  20,  20,  15,   0, -30,
+            -30,   5,  10,  15,  15,  10,   5, -30,
+            -40, -20,   0,   5,   5,   0, -20, -40,
+            -50, -40, -30, -30, -30, -30, -40, -50,
+        },
+        {
+            /* Bishop */
+            -20, -10, -10, -10, -10, -10, -10, -20,
+            -10,   0,   0,   0,   0,   0,   0, -10,
+            -10,   0,   5,  10,  10,   5,   0, -10,
+            -10,   5,   5,  10,  10,   5,   5, -10,
+            -10,   0,  10,  10,  10,  10,   0, -10,
+            -10,  10,  10,  10,  10,  10,  10, -10,
+            -10,   5,   0,   0,   0,   0,   5, -10,
+            -20, -10, -10, -10, -10, -10, -10, -20,
+        },
+        {
+            /* Queen */
+            -20, -10, -10,  -5,  -5, -10, -10, -20,
+            -10,   0,   0,   0,   0,   0,   0, -10,
+            -10,   0,   5,   5,   5,   5,   0, -10,
+             -5,   0,   5,   5,   5,   5,   0,  -5,
+              0,   0,   5,   5,   5,   5,   0,  -5,
+            -10,   5,   5,   5,   5,   5,   0, -10,
+            -10,   0,   5,   0,   0,   0,   0, -10,
+            -20, -10, -10,  -5,  -5, -10, -10, -20,
+        },
+        {
+            /* King */
+            -30, -40, -40, -50, -50, -40, -40, -30,
+            -30, -40, -40, -50, -50, -40, -40, -30,
+            -30, -40, -40, -50, -50, -40, -40, -30,
+            -30, -40, -40, -50, -50, -40, -40, -30,
+            -20, -30, -30, -40, -40, -30, -30, -20,
+            -10, -20, -20, -20, -20, -20, -20, -10,
+             20,  20,   0,   0,   0,   0,  20,  20,
+             20,  30,  10,   0,   0,  10,  30,  20,
+        },
+    },
+    {
+        /* Endgame */
+        {
+            /* Pawn */
+              0,   0,   0,   0,   0,   0,   0,   0,
+             80,  80,  80,  80,  80,  80,  80,  80,
+             50,  50,  50,  50,  50,  50,  50,  50,
+             30,  30,  30,  30,  30,  30,  30,  30,
+             20,  20,  20,  20,  20,  20,  20,  20,
+             10,  10,  10,  10,  10,  10,  10,  10,
+             10,  10,  10,  10,  10,  10,  10,  10,
+              0,   0,   0,   0,   0,   0,   0,   0,
+        },
+        {
+            /* Rook */
+              0,   0,   0,   0,   0,   0,   0,   0,
+             10,  10,  10,  10,  10,  10,  10,  10,
+              0,   0,   0,   0,   0,   0,   0,   0,
+              0,   0,   0,   0,   0,   0,   0,   0,
+              0,   0,   0,   0,   0,   0,   0,   0,
+              0,   0,   0,   0,   0,   0,   0,   0,
+              0,   0,   0,   0,   0,   0,   0,   0,
+              0,   0,   0,   0,   0,   0,   0,   0,
+        },
+        {
+            /* Knight */
+            -50, -40, -30, -30, -30, -30, -40, -50,
+            -40, -20,   0,   0,   0,   0, -20, -40,
+            -30,   0,  10,  15,  15,  10,   0, -30,
+            -30,   0,  15,  20,  20,  15,   0, -30,
+            -30,   0,  15,  20,  20,  15,   0, -30,
+            -30,   0,  10,  15,  15,  10,   0, -30,
+            -40, -20,   0,   0,   0,   0, -20, -40,
+            -50, -40, -30, -30, -30, -30, -40, -50,
+        },
+        {
+            /* Bishop */
+            -20, -10, -10, -10, -10, -10, -10, -20,
+            -10,   0,   0,   0,   0,   0,   0, -10,
+            -10,   0,   5,  10,  10,   5,   0, -10,
+            -10,   0,  10,  10,  10,  10,   0, -10,
+            -10,   0,  10,  10,  10,  10,   0, -10,
+            -10,   0,   5,  10,  10,   5,   0, -10,
+            -10,   0,   0,   0,   0,   0,   0, -10,
+            -20, -10, -10, -10, -10, -10, -10, -20,
+        },
+        {
+            /* Queen */
+            -20, -10, -10,  -5,  -5, -10, -10, -20,
+            -10,   0,   0,   0,   0,   0,   0, -10,
+            -10,   0,   5,   5,   5,   5,   0, -10,
+             -5,   0,   5,  10,  10,   5,   0,  -5,
+             -5,   0,   5,  10,  10,   5,   0,  -5,
+            -10,   0,   5,   5,   5,   5,   0, -10,
+            -10,   0,   0,   0,   0,   0,   0, -10,
+            -20, -10, -10,  -5,  -5, -10, -10, -20,
+        },
+        {
+            /* King */
+            -50, -40, -30, -20, -20, -30, -40, -50,
+            -30, -20, -10,   0,   0, -10, -20, -30,
+            -30, -10,  20,  30,  30,  20, -10, -30,
+            -30, -10,  30,  40,  40,  30, -10, -30,
+            -30, -10,  30,  40,  40,  30, -10, -30,
+            -30, -10,  20,  30,  30,  20, -10, -30,
+            -30, -30,   0,   0,   0,   0, -30, -30,
+            -50, -30, -30, -30, -30, -30, -30, -50,
+        },
+    },
+    /* clang-format on */
+};
+
+/* Tables for each piece, scaled by `piece_square_scale`, and negated for
+ * black */
+score_t piece_square[N_PLANES][N_SQUARES][N_TAPER];
+
+/* Scale of the current tables, -1 when they need to be built */
+int piece_square_built_scale[N_TAPER] = {-1, -1};
+
+/* Build `piece_square` from `piece_square_base` */
+static void build_piece_square(void) {
+  for (enum taper taper = TAPER_MG; taper < N_TAPER; taper++) {
+    int scale = piece_square_scale[taper];
+    for (enum piece type = PAWN; type < N_PIECE_T; type++) {
+      for (enum square square = A1; square < N_SQUARES; square++) {
+        /* The base tables start at rank 8, so white's square is flipped */
+        piece_square[type][square][taper] =
+            piece_square_base[taper][type][square ^ 56] * scale / 100;
+        piece_square[type + N_PIECE_T][square][taper] =
+            -piece_square_base[taper][type][square] * scale / 100;
+      }
+    }
+    piece_square_built_scale[taper] = scale;
+  }
+}
+
+/* Load the base tables from `piece_square_file`.  The file contains the
+ * numbers of `piece_square_base` in order, separated by whitespace - the
+ * middlegame tables, then the endgame tables, each for the pawn, rook, knight,
+ * bishop, queen and king, rank 8 first.  The tables are left unchanged if the
+ * file can't be read. */
+static void load_piece_square(struct engine *engine) {
+  FILE *f = fopen(piece_square_file, "r");
+  if (!f) {
+    perror(piece_square_file);
+    return;
+  }
+  score_t base[N_TAPER][N_PIECE_T][N_SQUARES];
+  score_t *value = &base[0][0][0];
+  int n_values = sizeof(base) / sizeof(base[0][0][0]);
+  int n_read = 0;
+  while (n_read < n_values && fscanf(f, "%d", &value[n_read]) == 1) n_read++;
+  fclose(f);
+  if (n_read < n_values) {
+    printf("Error (%s has %d of %d values)\n", piece_square_file, n_read,
+           n_values);
+    return;
+  }
+  memcpy(piece_square_base, base, sizeof(base));
+  /* Rebuild before the next search */
+  piece_square_built_scale[TAPER_MG] = -1;
+}
+
+/* Sum the piece-square tables for all the pieces in `position` */
+void calculate_piece_square(const struct position *position,
+                            score_t score[N_TAPER]) {
+  score[TAPER_MG] = 0;
+  score[TAPER_EG] = 0;
+  for (enum square square = A1; square < N_SQUARES; square++) {
+    int piece = position->piece_at[square];
+    if (piece == EMPTY) continue;
+    score[TAPER_MG] += piece_square[piece][square][TAPER_MG];
+    score[TAPER_EG] += piece_square[piece][square][TAPER_EG];
+  }
+}
+
+/* Blend the middlegame and endgame piece-square scores according to the
+ * material left on the board */
+static inline score_t taper_piece_square(const struct position *position) {
+  int phase = position->material_phase;
+  if (phase > MAX_MATERIAL_PHASE) phase = MAX_MATERIAL_PHASE;
+  return (position->piece_square_score[TAPER_MG] * phase +
+          position->piece_square_score[TAPER_EG] *
+              (MAX_MATERIAL_PHASE - phase)) /
+         MAX_MATERIAL_PHASE;
+}
+
+/*
+ *  Pawn hash table
+ *
+ *  Pawn structure terms depend only on the pawns of both players, which change
+ *  rarely between nodes, so they are cached in a table indexed by the pawn key
+ *  `position->pawn_hash`.  Each entry holds the scores for both players packed
+ *  into one word.  As in the transposition table, the key is stored XORed with
+ *  the data, so an entry torn by another thread writing at the same time fails
+ *  to match rather than returning a wrong score.
+ */
+
+struct pawn_entry {
+  hash_t key;    /* pawn_hash ^ data */
+  uint64_t data; /* White's score in the low 32 bits, black's in the high */
+};
+
+struct pawn_entry *pawn_table;
+unsigned long long pawn_table_mask;
+int pawn_allocated_mb = -1;
+
+/* Pawn structure terms which the scores in the table were calculated with */
+int pawn_built_doubled_penalty = -1;
+int pawn_built_passed_bonus = -1;
+
+/* Allocate the pawn hash table to the size given by `pawn_hash_mb`, rounded
+ * down to a power of two number of entries.  Called before searching. */
+void pawn_hash_resize(void) {
+  if (pawn_allocated_mb == pawn_hash_mb) return;
+  free(pawn_table);
+  pawn_table = 0;
+  pawn_table_mask = 0;
+  pawn_allocated_mb = pawn_hash_mb;
+  if (pawn_hash_mb == 0) return;
+  unsigned long long n_entries = (unsigned long long)pawn_hash_mb * 1024ull *
+                                 1024ull / sizeof(struct pawn_entry);
+  while (n_entries & (n_entries - 1)) n_entries &= n_entries - 1;
+  pawn_table = calloc(n_entries, sizeof(struct pawn_entry));
+  if (pawn_table) pawn_table_mask = n_entries - 1;
+}
+
+/* Clear the pawn hash table, so that it is filled with the current pawn
+ * structure terms */
+void pawn_hash_clear(void) {
+  if (pawn_table)
+    memset(pawn_table, 0, (pawn_table_mask + 1) * sizeof(struct pawn_entry));
+  pawn_built_doubled_penalty = doubled_pawn_penalty;
+  pawn_built_passed_bonus = passed_pawn_advance_bonus;
+}
+
 /*
  *  Functions
  */
 
+/* Return the moves of the piece at `square` for mobility.  Use the cached moves
+ * if they have been calculated, otherwise calculate them for the piece alone,
+ * so that evaluation doesn't cause all moves to be calculated.  King moves are
+ * always calculated alone, because the cached ones also depend on the
+ * opponent's moves and the score must be the same either way. */
+static inline bitboard_t get_eval_moves(const struct position *position,
+                                        enum square square) {
+  if (moves_calculated(position) &&
+      piece_type[(int)position->piece_at[square]] != KING)
+    return position->moves[(int)position->index_at[square]];
+  return get_piece_moves(position, square);
+}
+
+/* Score the pawn structure of one player - doubled and passed pawns */
+static score_t evaluate_pawns(const struct position *position,
+                              enum player player) {
+  score_t score = 0;
+  enum piece player_first_piece = N_PIECE_T * player;
+  enum piece opponent_first_piece = N_PIECE_T * !player;
+
+  /* Doubled pawns - look for pawn occupancy of >1 on any file */
+  bitboard_t pieces = position->a[PAWN + player_first_piece];
+  for (int file = 0; file < N_FILES; file++) {
+    if (pop_count(pieces & (0x0101010101010101ull << file)) > 1)
+      score -= doubled_pawn_penalty;
+  }
+
+  /* If the pawn is a passed pawn, reward its advancement across the board to
+   * encourage promotion even when promotion is beyond the search horizon. */
+  while (OPT_EVAL_PASSED && pieces) {
+    enum square square = bit2square(take_next_bit_from(&pieces));
+    if (!(front_spans[player][square] &
+          position->a[PAWN + opponent_first_piece])) {
+      int file = square / 8;
+      int advancement = player ? (6 - file) : (file - 1);
+      score += advancement * passed_pawn_advance_bonus;
+    }
+  }
+  return score;
+}
+
+/* Get the pawn structure scores for both players, from the pawn hash table if
+ * possible.  Probes and hits are counted in `result` unless it is null. */
+static void get_pawn_scores(const struct position *position,
+                            score_t scores[N_PLAYERS],
+                            struct search_result *result) {
+  struct pawn_entry *entry = 0;
+  if (pawn_table) {
+    if (result) result->pawn_hash_probes++;
+    entry = &pawn_table[position->pawn_hash & pawn_table_mask];
+    uint64_t data = entry->data;
+    if ((entry->key ^ data) == position->pawn_hash) {
+      if (result) result->pawn_hash_hits++;
+      scores[WHITE] = (int32_t)(uint32_t)data;
+      scores[BLACK] = (int32_t)(uint32_t)(data >> 32);
+      return;
+    }
+  }
+  scores[WHITE] = evaluate_pawns(position, WHITE);
+  scores[BLACK] = evaluate_pawns(position, BLACK);
+  if (entry) {
+    uint64_t data =
+        (uint64_t)(uint32_t)scores[WHITE] | (uint64_t)(uint32_t)scores[BLACK]
+                                                << 32;
+    entry->data = data;
+    entry->key = position->pawn_hash ^ data;
+  }
+}
+
 /* Evaluate one player's pieces, producing a positive score */
 static inline score_t evaluate_player(const struct position *position,
-                                      enum player player) {
+                                      enum player player,
+                                      const score_t pawn_scores[N_PLAYERS]) {
   int score = 0;
 
   enum piece player_first_piece = N_PIECE_T * player;
-  enum piece opponent_first_piece = N_PIECE_T * !player;
 
   /* Materials - score the number of each piece type according to
-   * `piece_weights` */
+   * `piece_weights`, from the counts kept in the position */
   for (int i = 0; i < N_PIECE_T; i++) {
-    score += piece_weights[i] * pop_count(position->a[i + player_first_piece]);
+    score += piece_weights[i] * position->piece_count[i + player_first_piece];
   }
 
   /* Mobility - a bonus for each possible move. */
   bitboard_t pieces = position->player_a[player];
   while (pieces) {
     enum square square = bit2square(take_next_bit_from(&pieces));
-    score += mobility_bonus * pop_count(get_moves(position, square));
+    score += mobility_bonus * pop_count(get_eval_moves(position, square));
   }
 
-  /* Doubled pawns - look for pawn occupancy of >1 on any rank of the B-stack */
-  pieces = position->b[PAWN + player_first_piece];
-  while (pieces) {
-    if (pop_count(pieces & 0xffull) > 1) score -= doubled_pawn_penalty;
-    pieces >>= 8;
-  }
+  /* Pawn structure, from the pawn hash table */
+  score += pawn_scores[player];
 
-  /* Blocked and passed pawns */
+  /* Blocked pawns - penalise pawns which can neither advance nor capture */
   pieces = position->a[PAWN + player_first_piece];
-  while (pieces) {
-    enum square square = bit2square(take_next_bit_from(&pieces));
-
-    /* Penalise blocked pawns which have no moves. */
-    if (pop_count(get_moves(position, square)) == 0ull)
-      score -= blocked_pawn_penalty;
-
-    /* If the pawn is a passed pawn, reward its advancement across the board to
-     * encourage promotion even when promotion is beyond the search horizon. */
-    if (OPT_EVAL_PASSED && !(front_spans[player][square] &
-                             position->a[PAWN + opponent_first_piece])) {
-      int file = square / 8;
-      int advancement = player ? (6 - file) : (file - 1);
-      score += advancement * passed_pawn_advance_bonus;
-    }
+  bitboard_t empty = ~position->total_a;
+  bitboard_t targets = position->player_a[!player];
+  bitboard_t can_move;
+  if (player == WHITE) {
+    targets |= position->en_passant & (0xffffffffull << 32);
+    can_move = (empty >> 8) | ((targets >> 9) & 0x7f7f7f7f7f7f7f7full) |
+               ((targets >> 7) & 0xfefefefefefefefeull);
+  } else {
+    targets |= position->en_passant & 0xffffffffull;
+    can_move = (empty << 8) | ((targets << 7) & 0x7f7f7f7f7f7f7f7full) |
+               ((targets << 9) & 0xfefefefefefefefeull);
   }
+  score -= pop_count(pieces & ~can_move) * blocked_pawn_penalty;
 
   /* Random element */
   if (randomness) {
@@ -139,18 +501,50 @@ static inline score_t evaluate_player(const struct position *position,
   return score;
 }
 
+/* Return the sum of both players' material, not counting the kings */
+static inline score_t total_material(const struct position *position) {
+  score_t material = 0;
+  for (int i = 0; i < KING; i++) {
+    material += piece_weights[i] * (position->piece_count[i] +
+                                    position->piece_count[i + N_PIECE_T]);
+  }
+  return material;
+}
+
+/* Return whether the game has reached the endgame, judged by the material left
+ * on the board */
 int is_endgame(const struct position *position) {
-  return (evaluate_player(position, WHITE) + evaluate_player(position, BLACK)) >
-         endgame_material;
+  return total_material(position) < endgame_material;
 }
 
 /* Evaluate a position, producing a score which is positive if the current
-   player is leading */
-score_t evaluate(const struct position *position) {
-  return (evaluate_player(position, WHITE) - evaluate_player(position, BLACK)) *
+   player is leading.  Pawn hash statistics are counted in the search thread's
+   `result`, which is null outside the search. */
+score_t evaluate(const struct position *position,
+                 struct search_result *result) {
+  score_t pawn_scores[N_PLAYERS];
+  get_pawn_scores(position, pawn_scores, result);
+  return (evaluate_player(position, WHITE, pawn_scores) -
+          evaluate_player(position, BLACK, pawn_scores) +
+          taper_piece_square(position)) *
          player_factor[position->turn];
 }
 
+/* Bring the evaluation up to date with the user options before searching
+ * `position`.  Pawn structure scores cached with other terms are discarded.
+ * The piece-square scores of `position` are recalculated in case
+ * it was set up with different tables. */
+void evaluate_prepare(struct position *position) {
+  pawn_hash_resize();
+  if (pawn_built_doubled_penalty != doubled_pawn_penalty ||
+      pawn_built_passed_bonus != passed_pawn_advance_bonus)
+    pawn_hash_clear();
+  if (piece_square_built_scale[TAPER_MG] != piece_square_scale[TAPER_MG] ||
+      piece_square_built_scale[TAPER_EG] != piece_square_scale[TAPER_EG])
+    build_piece_square();
+  calculate_piece_square(position, position->piece_square_score);
+}
+
 /* Initialise the module. */
 void evaluate_init() {
   /*
@@ -172,6 +566,9 @@ void evaluate_init() {
     front_spans[WHITE][square] = fs << (file + 8);
     front_spans[BLACK][square] = fs >> (64 - file);
   }
+
+  build_piece_square();
+  pawn_hash_resize();
 }
 
 /* Tests */
@@ -179,6 +576,6 @@ int test_eval(void) {
   struct position position;
   reset_board(&position);
   /* Starting positions should sum to zero */
-  ASSERT(evaluate(&position) == 0);
+  ASSERT(evaluate(&position, 0) == 0);
   return 0;
 }
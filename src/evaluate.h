@@ -10,8 +10,30 @@
 /* Position evaluation score */
 typedef int score_t;
 
+/* Pawn hash table size limits in MB */
+enum { PAWN_HASH_DEFAULT_MB = 1, PAWN_HASH_MAX_MB = 1024 };
+
+/* Material value of each piece type */
+extern int piece_weights[N_PIECE_T];
+
+/* Middlegame and endgame score of each piece at each square, positive for
+ * white and negative for black.  Built by `evaluate_init` and summed
+ * incrementally into `position->piece_square_score`. */
+extern score_t piece_square[N_PLANES][N_SQUARES][N_TAPER];
+
+/* Pawn hash table size option */
+extern int pawn_hash_mb;
+
+void pawn_hash_resize(void);
+void pawn_hash_clear(void);
+
 void evaluate_init();
-score_t evaluate(const struct position *position);
+void evaluate_prepare(struct position *position);
+void calculate_piece_square(const struct position *position,
+                            score_t score[N_TAPER]);
+struct search_result;
+score_t evaluate(const struct position *position,
+                 struct search_result *result);
 int is_endgame(const struct position *position);
 
 static inline int opening_pieces_left(const struct position *position,
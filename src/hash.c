@@ -4,20 +4,28 @@
 
 #include "hash.h"
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "options.h"
 #include "position.h"
+#include "search.h"
 
 /*
- * Transposition table size - number of entries, a prime number
  * Zobrist PRNG seed value - hardcoded for repeatable results
+ * Transposition table default and maximum sizes in MB
+ * Number of entries in a bucket - a bucket fills one 64-byte cache line
  */
 enum {
-  TT_SIZE = 15485867,
   ZOBRIST_SEED = 4587987,
-  N_TRIES = 2,
+  TT_DEFAULT_MB = 256,
+  TT_MAX_MB = 65536,
+  CACHE_LINE_SIZE = 64,
+  TT_BUCKET_SIZE = 4,
+  TT_AGE_PENALTY = 8,
+  TT_EMPTY_VALUE = -0x10000,
 };
 
 /*
@@ -62,102 +70,249 @@ void hash_init(void) {
 
 /*
  *  Transposition table
+ *
+ *  The table is an array of cache-line-sized buckets, each holding
+ *  `TT_BUCKET_SIZE` entries, so a probe costs a single cache miss.  The number
+ *  of buckets is a power of two and the bucket is indexed by the low bits of
+ *  the hash.  Each entry is two 64-bit words: the packed data, and the key,
+ *  which is the hash XORed with the data.  A reader only accepts an entry if
+ *  the XOR of the two words it reads gives back its own hash, so an entry torn
+ *  by another thread writing at the same time is rejected without any locking.
+ *
+ *  Entries are kept between searches, so that a search can use the results of
+ *  the previous one.  Each entry records the age of the search which last
+ *  stored or probed it, and the age only affects which entry is replaced.
  */
 
+/* Transposition table size option, in MB */
+int tt_size_mb = TT_DEFAULT_MB;
+
+/* Transposition table user options. */
+const struct option _tt_opts[] = {
+    /* clang-format off */
+  { "Hash",                  SPIN_OPT, .value.integer = &tt_size_mb,      1, TT_MAX_MB, 0 },
+    /* clang-format on */
+};
+const struct options tt_opts = {sizeof(_tt_opts) / sizeof(_tt_opts[0]),
+                                _tt_opts};
+
+/* A packed entry */
+struct tt_slot {
+  hash_t key;    /* hash ^ data */
+  uint64_t data; /* Packed fields, see below */
+};
+
+/* A cache line of entries */
+struct tt_bucket {
+  struct tt_slot slots[TT_BUCKET_SIZE];
+};
+
+/* Bit positions and widths of fields packed into `tt_slot.data` */
+enum {
+  TT_MOVE_SHIFT = 0,   /* 16 bits, a `move_t` */
+  TT_SCORE_SHIFT = 16,  /* 16 bits, signed */
+  TT_DEPTH_SHIFT = 32,  /* 8 bits, signed */
+  TT_TYPE_SHIFT = 40,   /* 2 bits */
+  TT_AGE_SHIFT = 42,    /* 8 bits */
+  TT_VALID_SHIFT = 50,  /* 1 bit - distinguishes an entry from empty */
+};
+
 int age;
-int updates;
-int collisions;
 
-/* Transposition table object */
-struct tt_entry *tt;
+/* Transposition table object - `tt_mem` is the allocated block and `tt` is the
+ * cache-line-aligned table within it */
+void *tt_mem;
+struct tt_bucket *tt;
+unsigned long long tt_n_buckets;
+int tt_allocated_mb;
+
+/* Pack the fields of an entry into a single word */
+static inline uint64_t tt_pack(enum tt_entry_type type, int depth,
+                               score_t score, move_t best_move) {
+  uint64_t data = 1ull << TT_VALID_SHIFT;
+  data |= (uint64_t)best_move << TT_MOVE_SHIFT;
+  data |= (uint64_t)(uint16_t)score << TT_SCORE_SHIFT;
+  data |= (uint64_t)(uint8_t)depth << TT_DEPTH_SHIFT;
+  data |= (uint64_t)(type & 0x3) << TT_TYPE_SHIFT;
+  data |= (uint64_t)(age & 0xff) << TT_AGE_SHIFT;
+  return data;
+}
+
+/* Unpack the fields of an entry */
+static inline void tt_unpack(uint64_t data, struct tt_entry *entry) {
+  entry->best_move = (move_t)(data >> TT_MOVE_SHIFT);
+  entry->score = (score_t)(int16_t)(uint16_t)(data >> TT_SCORE_SHIFT);
+  entry->depth = (int)(int8_t)(uint8_t)(data >> TT_DEPTH_SHIFT);
+  entry->type = (enum tt_entry_type)((data >> TT_TYPE_SHIFT) & 0x3);
+}
+
+/* Depth of a packed entry */
+static inline int tt_data_depth(uint64_t data) {
+  return (int)(int8_t)(uint8_t)(data >> TT_DEPTH_SHIFT);
+}
+
+/* Age of a packed entry */
+static inline int tt_data_age(uint64_t data) {
+  return (int)((data >> TT_AGE_SHIFT) & 0xff);
+}
+
+/* Allocate the table to the size given by `tt_size_mb`, rounded down to a power
+ * of two number of buckets.  If there isn't enough memory, halve the size until
+ * there is, and report the size used.  The old table is only freed once the
+ * new one is allocated, and is kept if no new one can be. */
+static void tt_alloc(void) {
+  unsigned long long bytes = (unsigned long long)tt_size_mb * 1024ull * 1024ull;
+  unsigned long long n_buckets = 1;
+  while (n_buckets * 2 * sizeof(struct tt_bucket) <= bytes) n_buckets *= 2;
+  void *mem;
+  for (;;) {
+    mem = calloc(1, (size_t)n_buckets * sizeof(struct tt_bucket) +
+                        CACHE_LINE_SIZE);
+    if (mem || n_buckets == 1) break;
+    n_buckets /= 2;
+  }
+  tt_allocated_mb = tt_size_mb;
+  if (!mem) {
+    printf("Can't allocate a transposition table of %d MB\n", tt_size_mb);
+    /* The search can't run without a table */
+    if (!tt_mem) exit(1);
+    return;
+  }
+  if (n_buckets * 2 * sizeof(struct tt_bucket) <= bytes) {
+    printf("Can't allocate a transposition table of %d MB, using %llu KB\n",
+           tt_size_mb, n_buckets * sizeof(struct tt_bucket) / 1024ull);
+  }
+  tt_exit();
+  tt_mem = mem;
+  tt_n_buckets = n_buckets;
+  tt = (struct tt_bucket *)(((uintptr_t)tt_mem + CACHE_LINE_SIZE - 1) &
+                            ~(uintptr_t)(CACHE_LINE_SIZE - 1));
+}
 
 /* Initialise transposition table memory. Call at program init. */
 void tt_init(void) {
-  tt = (struct tt_entry *)calloc(TT_SIZE, sizeof(struct tt_entry));
-  if (!tt) {
-    printf("Can't allocate %lu bytes for transposition table\n",
-           TT_SIZE * sizeof(struct tt_entry));
-    exit(1);
-  }
+  tt_alloc();
   age = 0;
 }
 
-/* Set a new age - the TT will only probe entries from the current age. */
+/* Reallocate the table if the "Hash" option has changed since it was
+ * allocated.  The contents are lost.  Called before searching. */
+void tt_resize(void) {
+  if (tt_allocated_mb == tt_size_mb) return;
+  tt_alloc();
+}
+
+/* Clear all entries from the transposition table */
+void tt_clear(void) {
+  memset(tt, 0, tt_n_buckets * sizeof(struct tt_bucket));
+}
+
+/* Set a new age, called after each search.  Entries from earlier ages can
+ * still be probed, but are the first to be replaced. */
 void tt_new_age(void) {
-  age++;
-  updates = 0;
-  collisions = 0;
+  age = (age + 1) & 0xff;
 }
 
 /* Free transposition table memory. Call at program exit. */
 void tt_exit(void) {
-  if (tt) free(tt);
+  if (tt_mem) free(tt_mem);
+  tt_mem = 0;
+  tt = 0;
 }
 
-/* Reset collision counters for transposition table */
-void tt_zero(void) {
-  updates = 0;
-  collisions = 0;
-}
+/* Number of entries in the table */
+unsigned long long tt_n_entries(void) { return tt_n_buckets * TT_BUCKET_SIZE; }
 
-/* Return percentage of transposition table updates resulting in collisions
-   since last call to tt_zero */
-double tt_collisions(void) {
-  return updates ? (double)collisions * 100.0 / (double)updates : 0.0;
+/* Return how full the table is, in permille, by sampling the first thousand
+ * entries for ones written during the current search */
+int tt_hashfull(void) {
+  int n_used = 0;
+  int n_sampled = 0;
+  for (unsigned long long i = 0; i < tt_n_buckets && n_sampled < 1000; i++) {
+    for (int j = 0; j < TT_BUCKET_SIZE; j++, n_sampled++) {
+      uint64_t data = tt[i].slots[j].data;
+      if (data && tt_data_age(data) == age) n_used++;
+    }
+  }
+  return n_sampled ? n_used * 1000 / n_sampled : 0;
 }
 
-/* Get an entry from the transposition table with the index that corresponds
-   to the supplied hash. The entry might not match the hash. */
-static inline struct tt_entry *tt_get(hash_t hash) {
-  hash_t index = hash % (hash_t)TT_SIZE;
-  return &tt[index];
+/* Size of a table entry in bytes */
+int tt_entry_size(void) { return (int)sizeof(struct tt_slot); }
+
+/* Get the bucket that corresponds to the supplied hash */
+static inline struct tt_bucket *tt_get(hash_t hash) {
+  return &tt[hash & (tt_n_buckets - 1)];
 }
 
-/* Update an entry in the transposition table, if the new information is found
-   at a greater depth than the existing entry. If the new entry has a hashes a
-   different position, a collision is recorded but the update is still made. */
-struct tt_entry *tt_update(hash_t hash, enum tt_entry_type type, int depth,
-                           score_t score, const struct move *best_move,
-                           bitboard_t occupancy) {
-  for (hash_t i = 0; i < N_TRIES; i++) {
-    struct tt_entry *ret = tt_get(hash + i);
-
-    /* A matching entry has been found but it has been searched to a greater
-     * depth - don't update. */
-    if (ret->age == age && ret->depth >= depth) return 0;
-
-    /* A hash table collision - an entry has been found from the same age which
-     * does not match the hash.  Try the next entry. */
-    if (ret->hash != 0 && ret->hash != hash && ret->age == age) continue;
-
-    /* A hash key collision */
-    if (ret->hash != 0 && ret->occupancy != occupancy) continue;
-
-    /* Update */
-    updates++;
-    ret->hash = hash;
-    ret->type = type;
-    ret->depth = (char)depth;
-    ret->score = score;
-    ret->age = age;
-    ret->occupancy = occupancy;
-    if (best_move) memcpy(&ret->best_move, best_move, sizeof(ret->best_move));
-    return ret;
+/* Update an entry in the transposition table.  An existing entry for the same
+   position is replaced unless it is from the current age and was searched to a
+   greater depth.  Otherwise, an empty entry is used if there is one, or else
+   the least valuable entry in the bucket is replaced: entries from earlier ages
+   are the first to go, then the shallowest.  Updates are counted in the search
+   thread's `result`, with those replacing an entry from the current age for a
+   different position counted as collisions. */
+void tt_update(hash_t hash, enum tt_entry_type type, int depth, score_t score,
+               move_t best_move, struct search_result *result) {
+  struct tt_bucket *bucket = tt_get(hash);
+  struct tt_slot *replace = 0;
+  int replace_value = 0;
+
+  for (int i = 0; i < TT_BUCKET_SIZE; i++) {
+    struct tt_slot *slot = &bucket->slots[i];
+    uint64_t data = slot->data;
+    hash_t key = slot->key;
+
+    /* Same position */
+    if (data && (key ^ data) == hash) {
+      if (tt_data_age(data) == age && tt_data_depth(data) > depth) return;
+      replace = slot;
+      break;
+    }
+
+    /* Empty, or another position valued by depth less a penalty for its age */
+    int value = TT_EMPTY_VALUE;
+    if (data) {
+      int stale = (age - tt_data_age(data)) & 0xff;
+      value = tt_data_depth(data) - stale * TT_AGE_PENALTY;
+    }
+    if (!replace || value < replace_value) {
+      replace = slot;
+      replace_value = value;
+    }
   }
 
-  /* After the maximum number of tries, don't update */
-  collisions++;
-  return 0;
+  uint64_t old = replace->data;
+  if (old && ((replace->key ^ old) != hash) && tt_data_age(old) == age)
+    result->tt_collisions++;
+  result->tt_updates++;
+
+  uint64_t data = tt_pack(type, depth, score, best_move);
+  replace->key = hash ^ data;
+  replace->data = data;
 }
 
-/* Probe the transposition table to get an entry which exactly matches the
-   supplied hash, or return zero if none is found. */
-struct tt_entry *tt_probe(hash_t hash, bitboard_t occupancy) {
-  for (hash_t i = 0; i < N_TRIES; i++) {
-    struct tt_entry *ret = tt_get(hash + i);
-    if (ret->hash != 0 && ret->hash == hash && ret->age == age &&
-        ret->occupancy == occupancy) {
-      return ret;
+/* Probe the transposition table for an entry which exactly matches the
+   supplied hash, from any age.  If found, unpack it into `entry` and return 1,
+   otherwise return 0.  An entry from an earlier age is brought up to the
+   current age, so that it is kept in preference to entries which are no longer
+   being used. */
+int tt_probe(hash_t hash, struct tt_entry *entry) {
+  if (!tt) return 0;
+  struct tt_bucket *bucket = tt_get(hash);
+  for (int i = 0; i < TT_BUCKET_SIZE; i++) {
+    struct tt_slot *slot = &bucket->slots[i];
+    uint64_t data = slot->data;
+    hash_t key = slot->key;
+    if (data && (key ^ data) == hash) {
+      if (tt_data_age(data) != age) {
+        data = (data & ~(0xffull << TT_AGE_SHIFT)) |
+               (uint64_t)(age & 0xff) << TT_AGE_SHIFT;
+        slot->key = hash ^ data;
+        slot->data = data;
+      }
+      tt_unpack(data, entry);
+      return 1;
     }
   }
   return 0;
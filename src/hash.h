@@ -36,26 +36,28 @@ enum tt_entry_type {
   TT_EXACT,
 };
 
-/* Transposition table entry */
+/* Transposition table entry as seen by the search.  Entries are stored packed
+ * in the table and unpacked into this struct by `tt_probe`. */
 struct tt_entry {
-  hash_t hash;
   enum tt_entry_type type;
-  char depth;
-  int age;
+  int depth;
   score_t score;
-  struct move best_move;
-  bitboard_t occupancy;
+  move_t best_move; /* NO_MOVE if there is none */
 };
 
+extern int tt_size_mb;
+
 void tt_exit(void);
-void tt_zero(void);
-double tt_collisions(void);
 void tt_init(void);
+void tt_resize(void);
 void tt_clear(void);
 void tt_new_age(void);
-struct tt_entry *tt_update(hash_t hash, enum tt_entry_type type, int depth,
-                           score_t score, const struct move *best_move,
-                           bitboard_t occupancy);
-struct tt_entry *tt_probe(hash_t hash, bitboard_t occupancy);
+unsigned long long tt_n_entries(void);
+int tt_entry_size(void);
+int tt_hashfull(void);
+struct search_result;
+void tt_update(hash_t hash, enum tt_entry_type type, int depth, score_t score,
+               move_t best_move, struct search_result *result);
+int tt_probe(hash_t hash, struct tt_entry *entry);
 
 #endif /* HASH_H */
@@ -5,47 +5,89 @@
 #include "history.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "debug.h"
 #include "io.h"
 #include "search.h"
 
-/* Push position hash onto the top of the history stack */
-void history_push(struct history *history, hash_t hash, struct move *move) {
-  history->hash[history->index] = hash;
-  history->is_breaking_move[history->index] =
-      (move->result & (CAPTURED | PROMOTED)) ? 1 : 0;
-  history->index++;
+/* Push position hash onto the top of the history stack, growing the storage
+   if it is full */
+void history_push(struct history *history, hash_t hash) {
+  if (history->index == history->size) {
+    int size = history->size ? history->size * 2 : HISTORY_MIN_SIZE;
+    hash_t *mem = (hash_t *)realloc(history->hash, size * sizeof(hash_t));
+    if (!mem) {
+      printf("Can't allocate %lu bytes for game history\n",
+             (unsigned long)(size * sizeof(hash_t)));
+      exit(1);
+    }
+    history->hash = mem;
+    history->size = size;
+  }
+  history->hash[history->index++] = hash;
+  history->filter.count[filter_bucket(hash)]++;
 }
 
 /* Pop position hash from the top of history stack */
 hash_t history_pop(struct history *history) {
-  ASSERT(history->index >= 0);
-  history->index--;
-  return history->hash[history->index];
+  ASSERT(history->index > 0);
+  hash_t hash = history->hash[--history->index];
+  history->filter.count[filter_bucket(hash)]--;
+  return hash;
 }
 
-/* Clear the position history */
+/* Clear the position history, keeping its storage */
 void history_clear(struct history *history) {
+  history->index = 0;
+  memset(&history->filter, 0, sizeof(history->filter));
+}
+
+/* Free the storage of a position history, leaving it empty */
+void history_free(struct history *history) {
+  free(history->hash);
   memset(history, 0, sizeof(*history));
 }
 
+/* Start an empty search stack on top of the game history */
+void stack_init(struct search_stack *stack, const struct history *game) {
+  stack->game = game;
+  stack->index = 0;
+  memset(&stack->filter, 0, sizeof(stack->filter));
+}
+
 /* Check for whether a position has been encountered before, to satisfy three-
-   or fivefold repetition rules. Search back every 2nd position from most recent
-   to bottom of stack, keeping a count of the number of times a hash is found on
-   the stack that matches the supplied hash.  `repetitions` specifies the total
-   number of repetitions including the current position, so the search is for
-   the remaining n-1 occurrences.  If a breaking move is encoutered which makes
-   it impossible for the position to be repeated, there is no need to continue
-   searching. Return true if there is are more repetitions than allowed.  */
-int is_repeated_position(const struct history *history, hash_t hash,
-                         int repetitions) {
-  int index = history->index;
+   or fivefold repetition rules.  `repetitions` specifies the total number of
+   repetitions including the current position, so the search is for the
+   remaining n-1 occurrences.  Return true if there are more repetitions than
+   allowed.
+
+   The hash filters rule out most positions at once.  Otherwise, search back
+   through the search stack, then the game history, comparing every second
+   position.  A capture or pawn move makes it impossible for earlier positions
+   to be repeated, so the search goes back no further than `halfmove` plies,
+   the number since the last one.  It also stops at a null move. */
+int is_repeated_position(const struct search_stack *stack, hash_t hash,
+                         int halfmove, int repetitions) {
+  const struct history *game = stack->game;
+  unsigned bucket = filter_bucket(hash);
+  if (!stack->filter.count[bucket] && !game->filter.count[bucket]) return 0;
+
   int count = 0;
-  while (index > 0) {
-    index -= 2;
-    if (history->hash[index] == hash) count++;
-    if (history->is_breaking_move[index] == hash) break;
+  int n_stack = (halfmove < stack->index) ? halfmove : stack->index;
+  for (int ply = 1; ply <= n_stack; ply++) {
+    hash_t previous = stack->hash[stack->index - ply];
+    if (previous == 0) return 0;
+    if ((ply & 1) == 0 && previous == hash && ++count >= repetitions - 1)
+      return 1;
+  }
+  for (int ply = stack->index + 1; ply <= halfmove; ply++) {
+    int index = game->index - (ply - stack->index);
+    if (index < 0) break;
+    if ((ply & 1) == 0 && game->hash[index] == hash &&
+        ++count >= repetitions - 1)
+      return 1;
   }
-  return (count >= (repetitions - 1));
+  return 0;
 }
@@ -8,16 +8,66 @@
 #include "position.h"
 #include "search.h"
 
-/* Position history stack */
+enum {
+  HISTORY_FILTER_SIZE = 1024, /* Buckets in a hash filter, a power of 2 */
+  HISTORY_MIN_SIZE = 256,     /* Positions allocated for a game at first */
+};
+
+/* Filter for the hashes in a list of positions - the number of positions in
+ * each bucket, selected by the low bits of the hash.  An empty bucket proves
+ * that a position is not in the list. */
+struct hash_filter {
+  unsigned short count[HISTORY_FILTER_SIZE];
+};
+
+/* Positions of the game before the current one, oldest first.  The storage
+ * grows as needed.  A zeroed struct is an empty history. */
 struct history {
+  int index; /* Number of positions */
+  int size;  /* Number of positions allocated */
+  hash_t *hash;
+  struct hash_filter filter;
+};
+
+/* Positions on the path from the root of a search to the current node, which
+ * continue from the game history.  Each search thread has its own.  A zero
+ * hash marks a null move, which no repetition can cross.  The search stops
+ * before its ply from the root reaches SEARCH_DEPTH_MAX, which bounds the
+ * stack. */
+struct search_stack {
+  const struct history *game;
   int index;
-  int is_breaking_move[REPEAT_HISTORY_SIZE];
-  hash_t hash[REPEAT_HISTORY_SIZE];
+  hash_t hash[SEARCH_DEPTH_MAX];
+  struct hash_filter filter;
 };
 
-void history_push(struct history *history, hash_t hash, struct move *move);
+static inline unsigned filter_bucket(hash_t hash) {
+  return (unsigned)hash & (HISTORY_FILTER_SIZE - 1);
+}
+
+/* Push the hash of the position being moved from onto a search stack */
+static inline void stack_push(struct search_stack *stack, hash_t hash) {
+  stack->hash[stack->index++] = hash;
+  stack->filter.count[filter_bucket(hash)]++;
+}
+
+/* Push a null move onto a search stack */
+static inline void stack_push_null(struct search_stack *stack) {
+  stack->hash[stack->index++] = 0;
+}
+
+/* Pop a position or null move from a search stack */
+static inline void stack_pop(struct search_stack *stack) {
+  hash_t hash = stack->hash[--stack->index];
+  if (hash) stack->filter.count[filter_bucket(hash)]--;
+}
+
+void history_push(struct history *history, hash_t hash);
 hash_t history_pop(struct history *history);
 void history_clear(struct history *history);
-int is_repeated_position(const struct history *history, hash_t hash, int moves);
+void history_free(struct history *history);
+void stack_init(struct search_stack *stack, const struct history *game);
+int is_repeated_position(const struct search_stack *stack, hash_t hash,
+                         int halfmove, int repetitions);
 
 #endif /* HISTORY_H */
@@ -4,11 +4,13 @@
 
 #include <ctype.h>
 #include <stdarg.h>
+#include <string.h>
 #include <time.h>
 
 #include "debug.h"
 #include "fen.h"
 #include "hash.h"
+#include "io.h"
 #include "os.h"
 #include "position.h"
 #include "pv.h"
@@ -126,6 +128,24 @@ int format_move_san(char *buf, const struct move *move) {
   return (int)(ptr - buf);
 }
 
+/* Unpack a move to be made from `position` for output, filling in the moving
+ * piece and the result of making it, as far as a check, so that it can be
+ * formatted in SAN.  Return 1 if there is no piece of the player to move on
+ * the from square, when only the squares and promotion are filled in. */
+int describe_move(const struct position *position, move_t packed,
+                  struct move *move) {
+  decode_move(packed, move);
+  if (packed == NO_MOVE) return 1;
+  int piece = position->piece_at[move->from];
+  if (piece == EMPTY || piece_player[piece] != position->turn) return 1;
+  move->piece = piece_type[piece];
+  struct position next;
+  copy_position(&next, position);
+  make_move(&next, move);
+  if (player_in_check(&next, opponent[next.turn])) move->result |= CHECK;
+  return 0;
+}
+
 /* Format a move to a string in coordinate format */
 int format_move(char *buf, struct move *move, int bare) {
   char *ptr = buf;
@@ -142,15 +162,38 @@ int format_move(char *buf, struct move *move, int bare) {
     if (move->result & CHECK) *ptr++ = '+';
     if (move->result & MATE) *ptr++ = '#';
   }
+  *ptr = 0;
   return (int)(ptr - buf);
 }
 
-/* Print the principal variation */
-void print_pv(FILE *f, const struct pv *pv) {
+/* Format a move to be made from `position` in SAN, or in coordinate format if
+ * it can't be described */
+static void format_packed_move(char *buf, const struct position *position,
+                               move_t packed) {
+  struct move move;
+  if (describe_move(position, packed, &move))
+    format_move(buf, &move, 1);
+  else
+    format_move_san(buf, &move);
+}
+
+/* Print the principal variation from `position` in SAN, or in coordinate
+ * format if `position` is null */
+void print_pv(FILE *f, const struct position *position, const struct pv *pv) {
   char buf[8];
-  int i;
-  for (i = 0; i < pv->length; i++) {
-    format_move_san(buf, &pv->moves[i]);
+  struct position next;
+  if (position) copy_position(&next, position);
+  for (int i = 0; i < pv->length; i++) {
+    struct move move;
+    if (position && !describe_move(&next, pv->moves[i], &move)) {
+      format_move_san(buf, &move);
+      make_move(&next, &move);
+      change_player(&next);
+    } else {
+      decode_move(pv->moves[i], &move);
+      format_move(buf, &move, 1);
+      position = 0;
+    }
     fprintf(f, "%s ", buf);
   }
 }
@@ -160,18 +203,19 @@ void print_pv(FILE *f, const struct pv *pv) {
  */
 
 /* Print the board, current position, and other data */
-void print_board(struct position *position, bitboard_t mask1,
+void print_board(const struct position *position, bitboard_t mask1,
                  bitboard_t mask2) {
   int rank, file;
   int term;
 
   term = is_terminal(stdout);
 
-  struct tt_entry *tte = tt_probe(position->hash, position->total_a);
+  struct tt_entry tt_buf;
+  struct tt_entry *tte = tt_probe(position->hash, &tt_buf) ? &tt_buf : 0;
 
   if (tte) {
-    mask1 = square2bit[tte->best_move.from];
-    mask2 = square2bit[tte->best_move.to];
+    mask1 = square2bit[move_from(tte->best_move)];
+    mask2 = square2bit[move_to(tte->best_move)];
   }
 
   printf("\n");
@@ -233,7 +277,7 @@ void print_board(struct position *position, bitboard_t mask1,
     if (tte) {
       switch (rank) {
         case 5:
-          format_move_san(buf, &tte->best_move);
+          format_packed_move(buf, position, tte->best_move);
           printf("     %s", buf);
           break;
         case 4:
@@ -255,10 +299,65 @@ void xboard_thought(struct search_job *job, struct pv *pv, int depth,
                     int seldep) {
   printf("  %2d %7d %7d %7d %d %.lf\t", depth, score, (int)(time * 100.0),
          nodes, seldep, knps);
-  print_pv(stdout, pv);
+  print_pv(stdout, &job->root_position, pv);
   printf("\n");
 }
 
+/* Print the progress of a search in response to the XBoard "." command */
+void xboard_status(double time, int nodes, int depth, int moves_left,
+                   int moves_total, const struct position *position,
+                   move_t packed) {
+  char buf[10];
+  format_packed_move(buf, position, packed);
+  printf("stat01: %d %d %d %d %d %s\n", (int)(time * 100.0), nodes, depth,
+         moves_left, moves_total, buf);
+}
+
+/* Return `part` as a percentage of `total` */
+static double percent(long long part, long long total) {
+  return total ? (double)part * 100.0 / (double)total : 0.0;
+}
+
+/* Print the statistics of a search */
+void print_search_stats(const struct search_result *result) {
+  double nps = result->time > 0.0 ? result->n_node / result->time : 0.0;
+  printf("Time                 %.3lf s\n", result->time);
+  printf("Nodes                %d (%.0lf nps)\n", result->n_node, nps);
+  printf("Leaf nodes           %d\n", result->n_leaf);
+  printf("Selective depth      %d\n", result->seldep);
+  printf("Branching factor     %.2lf\n", result->branching_factor);
+  printf("TT probes            %lld, %.1lf%% hits\n", result->tt_probes,
+         percent(result->tt_hits, result->tt_probes));
+  printf("Beta cutoffs         %lld, %.1lf%% by the first move\n",
+         result->n_cutoffs,
+         percent(result->n_first_move_cutoffs, result->n_cutoffs));
+#ifdef SEARCH_STATS
+  const struct search_stats *stats = &result->stats;
+  long long full_width = stats->pv_nodes + stats->cut_nodes + stats->all_nodes;
+  printf("PV nodes             %lld (%.1lf%%)\n", stats->pv_nodes,
+         percent(stats->pv_nodes, full_width));
+  printf("Cut nodes            %lld (%.1lf%%)\n", stats->cut_nodes,
+         percent(stats->cut_nodes, full_width));
+  printf("All nodes            %lld (%.1lf%%)\n", stats->all_nodes,
+         percent(stats->all_nodes, full_width));
+  printf("Quiescence nodes     %lld (%.1lf%% of nodes)\n",
+         stats->quiescence_nodes,
+         percent(stats->quiescence_nodes, result->n_node));
+  printf("TT cutoffs           %lld (%.1lf%% of hits)\n", stats->tt_cutoffs,
+         percent(stats->tt_cutoffs, result->tt_hits));
+  printf("Cutoffs by move     ");
+  for (int i = 0; i < N_CUTOFF_INDEX; i++)
+    printf(" %d%s:%.1lf%%", i + 1, (i == N_CUTOFF_INDEX - 1) ? "+" : "",
+           percent(stats->cutoff_index[i], result->n_cutoffs));
+  printf("\nNodes by ply        ");
+  for (int i = 0; i < SEARCH_DEPTH_MAX && stats->ply_nodes[i]; i++)
+    printf(" %d:%lld", i, stats->ply_nodes[i]);
+  printf("\n");
+#else
+  printf("Detailed statistics are not counted in this build\n");
+#endif
+}
+
 /* Print a move */
 void print_move(struct move *move) {
   char buf[100];
@@ -266,22 +365,146 @@ void print_move(struct move *move) {
   printf("%s\n", buf);
 }
 
+/*
+ *  Input queue
+ *
+ *  A reader thread blocks on stdin and queues each line as it arrives, so that
+ *  commands can be received while the engine is thinking.  The tokeniser
+ *  below consumes the queued lines.  Until the reader is started, input is
+ *  read from stdin directly.
+ */
+
+enum { INPUT_LINE_SIZE = 4096, INPUT_QUEUE_SIZE = 64 };
+
+static struct {
+  struct lock *lock;
+  struct thread *thread;
+  input_filter_fn filter;
+  char lines[INPUT_QUEUE_SIZE][INPUT_LINE_SIZE];
+  int head;  /* Next line to be read */
+  int count; /* Number of lines waiting */
+  int eof;   /* Reader has reached the end of stdin */
+} input_queue;
+
+/* The queued line being tokenised, and the next character to read from it */
+static char input_line[INPUT_LINE_SIZE];
+static const char *input_next = input_line;
+
+/* Reader thread entry point - queue lines from stdin until end of file */
+static void input_reader(void *arg) {
+  char line[INPUT_LINE_SIZE];
+  for (;;) {
+    int eof = !fgets(line, sizeof(line), stdin);
+    lock_acquire(input_queue.lock);
+    while (!eof && input_queue.count == INPUT_QUEUE_SIZE)
+      lock_wait(input_queue.lock);
+    if (eof) {
+      input_queue.eof = 1;
+    } else if (!input_queue.filter || input_queue.filter(line)) {
+      int tail = (input_queue.head + input_queue.count) % INPUT_QUEUE_SIZE;
+      strcpy(input_queue.lines[tail], line);
+      input_queue.count++;
+    }
+    lock_notify(input_queue.lock);
+    lock_release(input_queue.lock);
+    if (eof) return;
+  }
+}
+
+/* Start reading input on a separate thread.  Each line is passed to `filter`
+ * on the reader thread as it arrives, and is discarded if `filter` returns
+ * zero.  The filter is called with the queue locked, so it sees any change
+ * made before a call to `input_pending` that finds the queue empty.  Return 0
+ * if the thread was started. */
+int input_start(input_filter_fn filter) {
+  if (input_queue.thread) return 0;
+  input_queue.lock = lock_create();
+  if (!input_queue.lock) return 1;
+  input_queue.filter = filter;
+  input_queue.thread = thread_create(input_reader, 0);
+  if (!input_queue.thread) {
+    lock_destroy(input_queue.lock);
+    input_queue.lock = 0;
+    return 1;
+  }
+  return 0;
+}
+
+/* Make the next queued line current, waiting for one if `wait` is set.
+ * Return 1 if there is a new line, 0 if not, or EOF at the end of input. */
+static int input_next_line(int wait) {
+  int result;
+  lock_acquire(input_queue.lock);
+  while (wait && input_queue.count == 0 && !input_queue.eof)
+    lock_wait(input_queue.lock);
+  if (input_queue.count) {
+    strcpy(input_line, input_queue.lines[input_queue.head]);
+    input_queue.head = (input_queue.head + 1) % INPUT_QUEUE_SIZE;
+    input_queue.count--;
+    input_next = input_line;
+    lock_notify(input_queue.lock);
+    result = 1;
+  } else {
+    result = input_queue.eof ? EOF : 0;
+  }
+  lock_release(input_queue.lock);
+  return result;
+}
+
+/* Get the next input character, waiting for it if necessary */
+static int input_getc(void) {
+  if (!input_queue.thread) return fgetc(stdin);
+  while (*input_next == 0) {
+    if (input_next_line(1) == EOF) return EOF;
+  }
+  return (unsigned char)*input_next++;
+}
+
+/* Return true if a command can be read without waiting.  Whitespace and blank
+ * lines are skipped.  Always false if the reader thread has not been
+ * started. */
+int input_pending(void) {
+  if (!input_queue.thread) return 0;
+  for (;;) {
+    while (isspace((unsigned char)*input_next)) input_next++;
+    if (*input_next) return 1;
+    if (input_next_line(0) != 1) return 0;
+  }
+}
+
+/* Return true if all input has been read */
+int input_eof(void) {
+  if (!input_queue.thread) return feof(stdin);
+  if (*input_next) return 0;
+  lock_acquire(input_queue.lock);
+  int eof = input_queue.eof && input_queue.count == 0;
+  lock_release(input_queue.lock);
+  return eof;
+}
+
 /*
  *  Custom input tokeniser
  */
 
-/* Strip leading whitespace then get text from stdin up to the next whitespace
- * If text is enclosed by brackets {} return all enclosed text */
+/* Strip leading whitespace then get text from the input up to the next
+ * whitespace.  If text is enclosed by brackets {} return all enclosed text */
 void get_input_to_buf(char *buf, size_t buf_size) {
   char *ptr = buf;
   char *end = buf + buf_size - 1;
+  int c;
   /* Read input until first non whitespace character */
-  while (isspace(*ptr = fgetc(stdin)))
+  while (isspace(c = input_getc()))
     ;
+  if (c == EOF) {
+    *ptr = 0;
+    return;
+  }
+  *ptr = c;
   /* Handle brackets */
   if (*ptr == '{') {
     while (++ptr < end) {
-      *ptr = fgetc(stdin);
+      if ((c = input_getc()) == EOF) break;
+      *ptr = c;
       if (*ptr == '}') {
         ptr++;
         break;
@@ -292,32 +515,30 @@ void get_input_to_buf(char *buf, size_t buf_size) {
   }
   /* Read input until first whitespace character */
   while (++ptr < end) {
-    *ptr = fgetc(stdin);
-    if (isspace(*ptr)) break;
+    c = input_getc();
+    if (c == EOF || isspace(c)) break;
+    *ptr = c;
   }
   *ptr = 0;
 }
 
-#define INPUT_BUF_SIZE 1024
+#define INPUT_BUF_SIZE 4096
 char input_buf[INPUT_BUF_SIZE];
 
-/* Get text from stdin up to a delimiter char */
+/* Get text from the input up to a delimiter char */
 const char *get_delim(char delim) {
   char *ptr = input_buf;
   while (ptr < input_buf + sizeof(input_buf) - 1) {
-    *ptr = fgetc(stdin);
-    if (*ptr == delim) {
-      *ptr = 0;
-      return input_buf;
-    }
-    ptr++;
+    int c = input_getc();
+    if (c == EOF || c == delim) break;
+    *ptr++ = c;
   }
   *ptr = 0;
   return input_buf;
 }
 
-/* Strip leading whitespace then get text from stdin up to the next whitespace
- * If text is enclosed by brackets {} return all enclosed text */
+/* Strip leading whitespace then get text from the input up to the next
+ * whitespace.  If text is enclosed by brackets {} return all enclosed text */
 const char *get_input(void) {
   get_input_to_buf(input_buf, sizeof(input_buf));
   return input_buf;
@@ -18,19 +18,32 @@ struct pv;
 void print_board(const struct position *position, bitboard_t hl1,
                  bitboard_t hl2);
 void print_plane(bitboard_t plane, bitboard_t indicator);
-void print_move(const struct move *move);
+void print_move(struct move *move);
 void print_plane_rank(unsigned char rank, unsigned char indicator);
-void print_pv(FILE *out, const struct pv *pv);
+void print_pv(FILE *out, const struct position *position,
+              const struct pv *pv);
+
+/* Called on the input thread with each line read.  Return 0 to discard it. */
+typedef int (*input_filter_fn)(const char *line);
+int input_start(input_filter_fn filter);
+int input_pending(void);
+int input_eof(void);
 const char *get_input(void);
 void get_input_to_buf(char *buf, size_t buf_size);
 const char *get_delim(char delim);
 int parse_square(const char *in, enum square *square);
 int parse_move(const char *in, struct move *move);
 int format_square(char *out, enum square);
+int describe_move(const struct position *position, move_t packed,
+                  struct move *move);
 int format_move(char *out, struct move *move, int bare);
-int format_move_san(char *out, struct move *move);
+int format_move_san(char *out, const struct move *move);
 void xboard_thought(struct search_job *job, struct pv *pv, int depth,
                     score_t score, double time, int nodes, double knps,
                     int seldep);
+void xboard_status(double time, int nodes, int depth, int moves_left,
+                   int moves_total, const struct position *position,
+                   move_t move);
+void print_search_stats(const struct search_result *result);
 
 #endif /* IO_H */
@@ -1,5 +1,5 @@
 /*
- *   Functions to generate lists of moves for searching, and perft
+ *   Functions to generate lists of moves for searching
  */
 
 #include "movegen.h"
@@ -7,7 +7,7 @@
 #include <stdio.h>
 
 #include "history.h"
-#include "io.h"
+#include "moves.h"
 #include "position.h"
 
 /* Comparison and insertion for insertion sort.  Insert `insert` at the first
@@ -122,16 +122,18 @@ int generate_test_movelist(const struct position *position,
 }
 
 /* Generate a sorted linked list of moves at the buffer beginning at `move_buf`,
- * for a normal search from `position`, including all possible moves.  Update
+ * for a normal search from `position`, including all legal moves.  Update
  * `move_buf` to the head of the sorted list. */
 int generate_search_movelist(const struct position *position,
                              struct move_list **move_buf /* in/out */) {
   struct move_list *prev = 0;
   int count = 0;
+  struct legality legality;
+  get_legality(position, &legality);
   bitboard_t pieces = get_my_pieces(position);
   while (pieces) {
     enum square from = bit2square(take_next_bit_from(&pieces));
-    bitboard_t moves = get_moves(position, from);
+    bitboard_t moves = get_legal_moves(position, &legality, from);
     while (moves) {
       enum square to = bit2square(take_next_bit_from(&moves));
       add_movelist_entries(position, from, to, *move_buf, &prev, &count);
@@ -141,131 +143,282 @@ int generate_search_movelist(const struct position *position,
   return count;
 }
 
-/* Generate a sorted linked list of moves at the buffer beginning at `move_buf`,
- * for a quiescence search from `position`.  Update `move_buf` to the head of
- * the sorted list.  Quiescence search consists of all attacks to all pieces. */
-int generate_quiescence_movelist(const struct position *position,
-                                 struct move_list **move_buf /* in/out */) {
-  struct move_list *prev = 0;
+/* Generate all legal moves from `position` into the array `moves`, in no
+ * particular order, and return the number of moves.  Out of check, this is
+ * only moves of the king and pieces which answer the check. */
+int generate_legal_moves(const struct position *position, move_t *moves) {
   int count = 0;
-  bitboard_t victims =
-      position->claim[position->turn] & get_opponents_pieces(position);
-  while (victims) {
-    bitboard_t to_mask = take_next_bit_from(&victims);
-    enum square to = bit2square(to_mask);
-    bitboard_t attackers = get_attacks(position, to, position->turn);
-    while (attackers) {
-      bitboard_t from_mask = take_next_bit_from(&attackers);
-      enum square from = bit2square(from_mask);
-      add_movelist_entries(position, from, to, *move_buf, &prev, &count);
+  struct legality legality;
+  get_legality(position, &legality);
+  bitboard_t pieces = get_my_pieces(position);
+  if (!legality.targets) pieces = square2bit[legality.king];
+  while (pieces) {
+    enum square from = bit2square(take_next_bit_from(&pieces));
+    enum piece piece = piece_type[(int)position->piece_at[from]];
+    bitboard_t to_squares = get_legal_moves(position, &legality, from);
+    while (to_squares) {
+      enum square to = bit2square(take_next_bit_from(&to_squares));
+      enum piece promotion =
+          (piece == PAWN && is_promotion_move(position, from, to)) ? QUEEN
+                                                                   : PAWN;
+      do {
+        ASSERT(count < N_MOVES);
+        moves[count++] = pack_move(from, to, promotion);
+      } while (--promotion > PAWN);
     }
   }
-  if (count) sort_moves(move_buf);
   return count;
 }
 
-/* perft - A standard test to perform high-level validation of move generation
- * by recursively generating a tree of all moves for a given position to a given
- * depth, and counting the total moves and features (captured, en-passant,
- * castled, etc.) at leaf nodes, which can be compared to reference data. */
-void perft(struct perft_stats *data, struct position *position, int depth,
-           moveresult_t result) {
-  struct move_list move_buf[N_MOVES];
-  struct move_list *list_entry, *move_buf_head = move_buf;
-  struct position next_position;
-  struct perft_stats next_data;
-
-  memset(data, 0, sizeof(*data));
-
-  /* Leaf node - count one instance of a move and assess the features of the
-   * move_result of the move made by the parent iteration.  Test for check in
-   * the resulting position.  If in check, extend the search to test for
-   * checkmate by trying to find moves out of check. */
-  if (depth == 0) {
-    data->moves = 1;
-    if (result & CAPTURED) data->captures = 1;
-    if (result & EN_PASSANT) data->ep_captures = 1;
-    if (result & CASTLED) data->castles = 1;
-    if (result & PROMOTED) data->promotions = 1;
-
-    if (in_check(position)) {
-      data->checks = 1;
-      generate_search_movelist(position, &move_buf_head);
-      list_entry = move_buf_head;
-      int found_escape = 0;
-      while (list_entry) {
-        copy_position(&next_position, position);
-        make_move(&next_position, &list_entry->move);
-        if (!in_check(&next_position)) {
-          found_escape = 1;
-          break;
-        }
-        list_entry = list_entry->next;
+/* Return whether the player to move has a legal move, stopping at the first
+ * piece found with one.  With `in_check`, this tells checkmate and stalemate
+ * apart from positions where play goes on. */
+int has_legal_move(const struct position *position) {
+  struct legality legality;
+  get_legality(position, &legality);
+  bitboard_t pieces = get_my_pieces(position);
+  if (!legality.targets) pieces = square2bit[legality.king];
+  while (pieces) {
+    enum square from = bit2square(take_next_bit_from(&pieces));
+    if (get_legal_moves(position, &legality, from)) return 1;
+  }
+  return 0;
+}
+
+/*
+ *  Staged move picker
+ */
+
+/* Piece values for MVV-LVA ordering.  Kings are never victims, so their value
+ * only needs to make them the least preferred attacker. */
+static const int mvv_lva_value[N_PIECE_T] = {1, 5, 3, 3, 9, 10};
+
+/* Add a move to the picker with `score`, adding entries for all possible
+ * promotions.  Return the index of the first entry added. */
+static inline int picker_add(struct move_picker *picker, enum square from,
+                             enum square to, int score) {
+  const struct position *position = picker->position;
+  enum piece piece = piece_type[(int)position->piece_at[from]];
+  enum piece promotion =
+      (piece == PAWN && is_promotion_move(position, from, to)) ? QUEEN : PAWN;
+  int first = picker->end;
+  do {
+    ASSERT(picker->end < N_MOVES);
+    picker->moves[picker->end] = pack_move(from, to, promotion);
+    picker->scores[picker->end] = score;
+    picker->end++;
+  } while (--promotion > PAWN);
+  return first;
+}
+
+/* Generate captures, and promotions unless in quiescence.  Order them by static
+ * exchange evaluation, then by MVV-LVA.  Captures which lose material have
+ * negative scores. */
+static void picker_generate_captures(struct move_picker *picker) {
+  const struct position *position = picker->position;
+  bitboard_t targets = get_opponents_pieces(position);
+  bitboard_t promotions = picker->quiescence ? 0 : 0xff000000000000ffull;
+  bitboard_t pieces = get_my_pieces(position);
+  while (pieces) {
+    enum square from = bit2square(take_next_bit_from(&pieces));
+    int attacker = piece_type[(int)position->piece_at[from]];
+    bitboard_t moves = get_legal_moves(position, &picker->legality, from);
+    if (attacker == PAWN) {
+      moves &= targets | position->en_passant | promotions;
+    } else {
+      moves &= targets;
+    }
+    while (moves) {
+      enum square to = bit2square(take_next_bit_from(&moves));
+      int mvv_lva = 0;
+      if (position->piece_at[to] != EMPTY) {
+        mvv_lva = mvv_lva_value[piece_type[(int)position->piece_at[to]]] * 16 -
+                  mvv_lva_value[attacker];
+      } else if (square2bit[to] & position->en_passant) {
+        mvv_lva = mvv_lva_value[PAWN] * 16 - mvv_lva_value[PAWN];
+      }
+      for (int i = picker_add(picker, from, to, 0); i < picker->end; i++) {
+        picker->scores[i] = see(position, picker->moves[i]) * 256 + mvv_lva;
       }
-      if (!found_escape) data->checkmates = 1;
     }
-    return;
   }
+  picker->n_captures = picker->end;
+}
 
-  /* Branch node - generate all moves, make each one, recurse into `perft`, and
-   * total the data for all moves. */
-  generate_search_movelist(position, &move_buf_head);
-  list_entry = move_buf_head;
-  while (list_entry) {
-    copy_position(&next_position, position);
-    make_move(&next_position, &list_entry->move);
-    /* Can't move into check */
-    if (!in_check(&next_position)) {
-      change_player(&next_position);
-      perft(&next_data, &next_position, depth - 1, list_entry->move.result);
-      data->moves += next_data.moves;
-      data->captures += next_data.captures;
-      data->promotions += next_data.promotions;
-      data->castles += next_data.castles;
-      data->checks += next_data.checks;
-      data->checkmates += next_data.checkmates;
-      data->ep_captures += next_data.ep_captures;
+/* Generate quiet moves, scored by the history heuristic if there is a table,
+ * otherwise by the type of the moving piece */
+static void picker_generate_quiets(struct move_picker *picker) {
+  const struct position *position = picker->position;
+  bitboard_t empty = ~position->total_a & ~position->en_passant;
+  bitboard_t pieces = get_my_pieces(position);
+  while (pieces) {
+    enum square from = bit2square(take_next_bit_from(&pieces));
+    int piece = piece_type[(int)position->piece_at[from]];
+    bitboard_t moves =
+        get_legal_moves(position, &picker->legality, from) & empty;
+    if (piece == PAWN) moves &= ~0xff000000000000ffull;
+    while (moves) {
+      enum square to = bit2square(take_next_bit_from(&moves));
+      int i = picker_add(picker, from, to, piece);
+      if (picker->butterfly) picker->scores[i] = picker->butterfly[from][to];
     }
-    list_entry = list_entry->next;
   }
 }
 
-/* For each move from a given position, perform a perft on the following
- * position, and report the number of moves. */
-void perft_divide(struct position *position, int depth) {
-  struct move_list move_buf[N_MOVES];
-  struct move_list *list_entry, *move_buf_head = move_buf;
-  struct position next_position;
-  struct perft_stats next_data;
-  char buf[6];
-
-  generate_search_movelist(position, &move_buf_head);
-  list_entry = move_buf_head;
-  while (list_entry) {
-    copy_position(&next_position, position);
-    make_move(&next_position, &list_entry->move);
-    /* Can't move into check */
-    if (!in_check(&next_position)) {
-      change_player(&next_position);
-      perft(&next_data, &next_position, depth - 1, list_entry->move.result);
-      format_move_san(buf, &list_entry->move);
-      printf("%s: %lld\n", buf, next_data.moves);
-    }
-    list_entry = list_entry->next;
+/* Swap the move with the highest score in `picker->moves[first..end-1]` into
+ * `first` and return its score */
+static inline int picker_select(struct move_picker *picker, int first,
+                                int end) {
+  int best = first;
+  for (int i = first + 1; i < end; i++) {
+    if (picker->scores[i] > picker->scores[best]) best = i;
+  }
+  if (best != first) {
+    move_t move = picker->moves[first];
+    int score = picker->scores[first];
+    picker->moves[first] = picker->moves[best];
+    picker->scores[first] = picker->scores[best];
+    picker->moves[best] = move;
+    picker->scores[best] = score;
+  }
+  return picker->scores[first];
+}
+
+/* A generated move has already been picked in the TT move or refutation
+ * stages */
+static inline int picker_already_picked(const struct move_picker *picker,
+                                        move_t move) {
+  if (move == picker->tt_move) return 1;
+  for (int i = 0; i < picker->n_refutations; i++) {
+    if (move == picker->refutations[i]) return 1;
+  }
+  return 0;
+}
+
+/* A move from the transposition table or a refutation, which was found in
+ * another position, is legal in this one */
+static inline int picker_is_legal(const struct move_picker *picker,
+                                  move_t move) {
+  const struct position *position = picker->position;
+  enum square from = move_from(move);
+  enum square to = move_to(move);
+  if (from == to || !(square2bit[from] & get_my_pieces(position))) return 0;
+  if (!(square2bit[to] & get_legal_moves(position, &picker->legality, from)))
+    return 0;
+  /* A pawn moving to the back row must promote, and no other move can */
+  int promotes = (piece_type[(int)position->piece_at[from]] == PAWN) &&
+                 is_promotion_move(position, from, to);
+  return promotes == (move_promotion(move) > PAWN);
+}
+
+/* Add `move` to the refutations to try, unless it is empty, a duplicate, or
+ * not quiet in this position.  Captures are left to the capture stages. */
+static inline void picker_add_refutation(struct move_picker *picker,
+                                         move_t move) {
+  if (move == NO_MOVE || !is_quiet_move(picker->position, move)) return;
+  for (int i = 0; i < picker->n_refutations; i++) {
+    if (move == picker->refutations[i]) return;
   }
+  picker->refutations[picker->n_refutations++] = move;
 }
 
-/* Perform multiple perft tests to increasing depths and print the results in a
- * formatted table. */
-void perft_total(struct position *position, int depth) {
-  printf("%8s%16s%12s%12s%12s%12s%12s%12s%12s%12s\n", "Depth", "Nodes",
-         "Captures", "E.P.", "Castles", "Promotions", "Checks", "Disco Chx",
-         "Double Chx", "Checkmates");
-  for (int i = 1; i <= depth; i++) {
-    struct perft_stats data;
-    perft(&data, position, i, 0);
-    printf("%8d%16lld%12ld%12ld%12ld%12ld%12ld%12s%12s%12ld\n", i, data.moves,
-           data.captures, data.ep_captures, data.castles, data.promotions,
-           data.checks, "X", "X", data.checkmates);
+/* Initialise `picker` for `position`.  `tt_move` is tried first, then
+ * `killers` (an array of `N_KILLERS`, or null) and `countermove` after the good
+ * captures, if they are not NO_MOVE and are legal quiet moves.  Quiet moves are
+ * ordered by `butterfly`, the history scores of the player to move, if it is
+ * not null.  In quiescence, only captures are picked. */
+void picker_init(struct move_picker *picker, const struct position *position,
+                 move_t tt_move, const move_t *killers, move_t countermove,
+                 int (*butterfly)[N_SQUARES], int quiescence) {
+  picker->position = position;
+  picker->quiescence = quiescence;
+  picker->stage = PICK_TT_MOVE;
+  picker->next = 0;
+  picker->n_captures = 0;
+  picker->next_quiet = 0;
+  picker->end = 0;
+  picker->tt_move = tt_move;
+  picker->n_refutations = 0;
+  picker->next_refutation = 0;
+  picker->butterfly = butterfly;
+  get_legality(position, &picker->legality);
+  if (quiescence) return;
+  for (int i = 0; killers && i < N_KILLERS; i++)
+    picker_add_refutation(picker, killers[i]);
+  picker_add_refutation(picker, countermove);
+}
+
+/* Return the next move to search, or NO_MOVE when there are no more.  All
+ * moves are legal. */
+move_t picker_next(struct move_picker *picker) {
+  for (;;) {
+    switch (picker->stage) {
+      case PICK_TT_MOVE:
+        picker->stage = PICK_GEN_CAPTURES;
+        if (picker->tt_move != NO_MOVE) {
+          if (picker_is_legal(picker, picker->tt_move)) return picker->tt_move;
+          picker->tt_move = NO_MOVE;
+        }
+        break;
+
+      case PICK_GEN_CAPTURES:
+        picker_generate_captures(picker);
+        picker->stage = PICK_GOOD_CAPTURES;
+        break;
+
+      case PICK_GOOD_CAPTURES:
+        while (picker->next < picker->n_captures) {
+          if (picker_select(picker, picker->next, picker->n_captures) < 0)
+            break;
+          move_t move = picker->moves[picker->next++];
+          if (!picker_already_picked(picker, move)) return move;
+        }
+        /* Quiescence doesn't search captures which lose material */
+        picker->stage = picker->quiescence ? PICK_DONE : PICK_REFUTATIONS;
+        break;
+
+      case PICK_REFUTATIONS:
+        /* A refutation which is not legal here is removed, so that it isn't
+         * skipped as a quiet move */
+        while (picker->next_refutation < picker->n_refutations) {
+          move_t move = picker->refutations[picker->next_refutation];
+          if (picker_is_legal(picker, move) && move != picker->tt_move) {
+            picker->next_refutation++;
+            return move;
+          }
+          picker->refutations[picker->next_refutation] =
+              picker->refutations[--picker->n_refutations];
+        }
+        picker->stage = PICK_GEN_QUIETS;
+        break;
+
+      case PICK_GEN_QUIETS:
+        picker->next_quiet = picker->end;
+        picker_generate_quiets(picker);
+        picker->stage = PICK_QUIETS;
+        break;
+
+      case PICK_QUIETS:
+        while (picker->next_quiet < picker->end) {
+          picker_select(picker, picker->next_quiet, picker->end);
+          move_t move = picker->moves[picker->next_quiet++];
+          if (!picker_already_picked(picker, move)) return move;
+        }
+        picker->stage = PICK_BAD_CAPTURES;
+        break;
+
+      case PICK_BAD_CAPTURES:
+        while (picker->next < picker->n_captures) {
+          picker_select(picker, picker->next, picker->n_captures);
+          move_t move = picker->moves[picker->next++];
+          if (!picker_already_picked(picker, move)) return move;
+        }
+        picker->stage = PICK_DONE;
+        break;
+
+      case PICK_DONE:
+      default:
+        return NO_MOVE;
+    }
   }
 }
@@ -1,31 +1,60 @@
 /*
- *   Move list generation, sorting, and perft
+ *   Move list generation and sorting
  */
 
 #ifndef MOVEGEN_H
 #define MOVEGEN_H
 
+#include "moves.h"
 #include "search.h"
 
-/* Perft statistics */
-struct perft_stats {
-  unsigned long long moves;
-  unsigned long captures;
-  unsigned long promotions;
-  unsigned long en_passant;
-  unsigned long ep_captures;
-  unsigned long castles;
-  unsigned long checks;
-  unsigned long checkmates;
+/* Stages of the move picker, in the order that they are reached */
+enum pick_stage {
+  PICK_TT_MOVE,       /* Best move from the transposition table */
+  PICK_GEN_CAPTURES,  /* Generate captures and promotions */
+  PICK_GOOD_CAPTURES, /* Captures with SEE >= 0, best first */
+  PICK_REFUTATIONS,   /* Killer moves and the countermove */
+  PICK_GEN_QUIETS,    /* Generate quiet moves */
+  PICK_QUIETS,        /* Quiet moves */
+  PICK_BAD_CAPTURES,  /* Captures with SEE < 0 */
+  PICK_DONE
 };
 
+/* Quiet moves tried before the rest - the killers and the countermove */
+enum { N_REFUTATIONS = N_KILLERS + 1 };
+
+/* Staged move picker.  Moves for each stage are only generated when the stage
+ * is reached, into a flat array, and the best remaining move is selected on
+ * demand rather than sorting the whole list.  A cutoff from an early move saves
+ * generating and ordering the rest.  Captures are stored at the start of
+ * `moves`, and quiet moves after them. */
+struct move_picker {
+  const struct position *position;
+  move_t tt_move; /* NO_MOVE if there is none */
+  move_t refutations[N_REFUTATIONS];
+  int n_refutations;
+  int next_refutation;
+  struct legality legality;    /* Checks and pins, to generate legal moves */
+  int (*butterfly)[N_SQUARES]; /* History scores for quiet moves */
+  int quiescence;       /* Only pick captures with SEE >= 0 */
+  enum pick_stage stage;
+  int next;             /* Next capture to select from */
+  int n_captures;       /* Number of captures */
+  int next_quiet;       /* Next quiet move to select from */
+  int end;              /* End of all generated moves */
+  move_t moves[N_MOVES];
+  int scores[N_MOVES];
+};
+
+void picker_init(struct move_picker *picker, const struct position *position,
+                 move_t tt_move, const move_t *killers, move_t countermove,
+                 int (*butterfly)[N_SQUARES], int quiescence);
+move_t picker_next(struct move_picker *picker);
 int generate_test_movelist(const struct position *position,
                            struct move_list **move_buf);
 int generate_search_movelist(const struct position *position,
                              struct move_list **move_list);
-int generate_quiescence_movelist(const struct position *position,
-                                 struct move_list **move_list);
-void perft_total(struct position *position, int depth);
-void perft_divide(struct position *position, int depth);
+int generate_legal_moves(const struct position *position, move_t *moves);
+int has_legal_move(const struct position *position);
 
 #endif /* MOVEGEN_H */
@@ -3,76 +3,13 @@
  */
 
 #include "debug.h"
+#include "evaluate.h"
 #include "io.h"
+#include "moves.h"
 #include "position.h"
 
-typedef unsigned char rank_t;
-
 /* clang-format off */
 
-/* 
- * Lookup tables - for each A-square, the shift amount that the C-stack must be
- * shifted to get the start of a diagonal row, and the mask that must be applied
- * following the shift to obtain only the row.
- *
- *     A square  Shift     Mask 
- *               ...etc
- *      9 8 7 6  6         0x0f
- *       5 4 3   3         0x07
- *        2 1    1         0x03
- *         0     0         0x01
- *
- * Reflections in the vertical axis for D-square counterparts are generated by
- * `init_moves`.
- */
-const enum square shift_c[N_SQUARES] = {
-   0,  1,  3,  6, 10, 15, 21, 28,
-   1,  3,  6, 10, 15, 21, 28, 36,
-   3,  6, 10, 15, 21, 28, 36, 43,
-   6, 10, 15, 21, 28, 36, 43, 49,
-  10, 15, 21, 28, 36, 43, 49, 54,
-  15, 21, 28, 36, 43, 49, 54, 58,
-  21, 28, 36, 43, 49, 54, 58, 61,
-  28, 36, 43, 49, 54, 58, 61, 63
-};
-const rank_t mask_c[N_SQUARES] = {
-  0x01, 0x03, 0x07, 0x0f, 0x1f, 0x3f, 0x7f, 0xff,
-  0x03, 0x07, 0x0f, 0x1f, 0x3f, 0x7f, 0xff, 0x7f,
-  0x07, 0x0f, 0x1f, 0x3f, 0x7f, 0xff, 0x7f, 0x3f,
-  0x0f, 0x1f, 0x3f, 0x7f, 0xff, 0x7f, 0x3f, 0x1f,
-  0x1f, 0x3f, 0x7f, 0xff, 0x7f, 0x3f, 0x1f, 0x0f,
-  0x3f, 0x7f, 0xff, 0x7f, 0x3f, 0x1f, 0x0f, 0x07,
-  0x7f, 0xff, 0x7f, 0x3f, 0x1f, 0x0f, 0x07, 0x03,
-  0xff, 0x7f, 0x3f, 0x1f, 0x0f, 0x07, 0x03, 0x01
-};
-rank_t shift_d[N_SQUARES];
-rank_t mask_d[N_SQUARES];
-
-/* 
- * Lookup tables - Amount that occupancy mask occ_c2a[occ] must be shifted to
- * get to the correct diagonal
- */
-const enum square shift_c2a[N_SQUARES] = {
-  0,  1,  2,  3,  4,  5,  6,  7,
-  1,  2,  3,  4,  5,  6,  7, 15,
-  2,  3,  4,  5,  6,  7, 15, 23,
-  3,  4,  5,  6,  7, 15, 23, 31,
-  4,  5,  6,  7, 15, 23, 31, 39,
-  5,  6,  7, 15, 23, 31, 39, 47,
-  6,  7, 15, 23, 31, 39, 47, 55,
-  7, 15, 23, 31, 39, 47, 55, 63,
-};
-const enum square shift_d2a[N_SQUARES] = {
-   0,  1,  2,  3,  4,  5,  6,  7,
-   8,  0,  1,  2,  3,  4,  5,  6,
-  16,  8,  0,  1,  2,  3,  4,  5,
-  24, 16,  8,  0,  1,  2,  3,  4,
-  32, 24, 16,  8,  0,  1,  2,  3,
-  40, 32, 24, 16,  8,  0,  1,  2,
-  48, 40, 32, 24, 16,  8,  0,  1,
-  56, 48, 40, 32, 24, 16,  8,  0
-};
-
 /* Starting positions encoded as A-stack */
 const bitboard_t starting_a[N_PLANES] = {
   /* Pawns     Rooks        Bishops      Knights      Queen        King                 */
@@ -97,19 +34,23 @@ const bitboard_t rook_castle_slides[N_PLAYERS][2] = {
 const bitboard_t castle_destinations[N_PLAYERS][2] = {
     {0x04ull, 0x40ull}, {0x04ull << 56, 0x40ull << 56}};
 
-extern const enum square square_a2b[N_SQUARES];
-extern const enum square square_a2c[N_SQUARES];
-extern const enum square square_a2d[N_SQUARES];
 extern const castle_rights_t castling_rights[N_PLAYERS][N_BOARDSIDE];
 
-/* Lookup table of permitted slide moves for a rank, given file position and
- * rank occupancy, generated  by `init_moves`, used to calculate Rook, Bishop
- * and Queen moves */
-rank_t permitted_slide_moves[8][256];
-
-/* For B,C,D-stacks, bitboards which convert rank occupancy into a vertical or
-   diagonal bitboard in A-plane, which are generated by `init_moves` */
-bitboard_t occ_b2a[256], occ_c2a[256], occ_d2a[256];
+/* Slider attack lookups and the tables of attack sets that they index into,
+ * generated by `init_moves`.  A rook needs 2^10 to 2^12 entries per square, and
+ * a bishop 2^5 to 2^9, depending on the number of relevant occupancy squares.
+ */
+enum { ROOK_TABLE_SIZE = 102400, BISHOP_TABLE_SIZE = 5248 };
+struct magic rook_magics[N_SQUARES];
+struct magic bishop_magics[N_SQUARES];
+static bitboard_t rook_table[ROOK_TABLE_SIZE];
+static bitboard_t bishop_table[BISHOP_TABLE_SIZE];
+
+#if defined(USE_PEXT)
+const char slider_backend[] = "pext";
+#else
+const char slider_backend[] = "magic";
+#endif
 
 /* Bitboards for knight and king moves which are generated by `init_moves`. */
 bitboard_t knight_moves[N_SQUARES], king_moves[N_SQUARES];
@@ -118,12 +59,17 @@ bitboard_t knight_moves[N_SQUARES], king_moves[N_SQUARES];
 bitboard_t pawn_advances[N_PLAYERS][N_SQUARES],
     pawn_takes[N_PLAYERS][N_SQUARES];
 
+/* For each pair of squares on the same rank, file or diagonal, the squares
+ * strictly between them, and the whole line through them, which are generated
+ * by `init_moves`.  Both are empty for squares which are not aligned. */
+bitboard_t between[N_SQUARES][N_SQUARES], line_through[N_SQUARES][N_SQUARES];
+
 /* Return a bitboard containing the valid pawn move destinations for a given
  * position, taking into account captures and blockages by other pieces.  For
  * simplicity, include moves where pawns can take their own side's pieces (these
  * are filtered out elsewhere). */
-static bitboard_t get_pawn_moves(struct position *position, enum square square,
-                                 enum player player) {
+static bitboard_t get_pawn_moves(const struct position *position,
+                                 enum square square, enum player player) {
   /*
    * Pawns can advance forward by one or two squares as dictated by
    * `pawn_advances`, if they not are blocked from moving by other pieces.  A
@@ -153,90 +99,28 @@ static bitboard_t get_pawn_moves(struct position *position, enum square square,
  * position, taking into account captures and blockages by other pieces.  For
  * simplicity, include moves where rooks can take their own side's pieces (these
  * are filtered out elsewhere). */
-static bitboard_t get_rook_moves(struct position *position,
-                                 enum square a_square) {
-  /*
-   * Rook move generation reduces to a case for a single 8-bit rank which is
-   * handled by an 8 x 256 lookup table.  To calculate horizontal moves, for the
-   * rank containing the piece, calculate:
-   *  - the shift required to the bitboard to shift the rank down to rank zero
-   *  - the file of the moving piece within the rank
-   *  - the piece occupancy of other pieces in the rank
-   * Then look up the permitted moves for the piece, given the occupancy and
-   * file, then shift the permitted moves back onto a bitboard at the original
-   * rank. The process is repeated on the 90-degree-rotated B-stack to calculate
-   * the vertical moves, and a lookup table is used to convert the moves to a
-   * bitboard in the A-stack which is shifted to the correct file, and finally
-   * combined with the horizontal moves.
-   */
-  int a_shift = a_square & ~7ul;
-  int a_file = a_square & 7ul;
-  rank_t a_occupancy = (rank_t)((position->total_a >> a_shift) & 0xfful);
-  rank_t a_moves = permitted_slide_moves[a_file][a_occupancy];
-  bitboard_t h_mask = (bitboard_t)a_moves << a_shift;
-
-  int b_square = square_a2b[a_square];
-  int b_shift = b_square & ~7ul;
-  int b_file = b_square & 7ul;
-  rank_t b_occupancy = (rank_t)((position->total_b >> b_shift) & 0xfful);
-  rank_t b_moves = permitted_slide_moves[b_file][b_occupancy];
-  bitboard_t b_mask = occ_b2a[b_moves];
-  bitboard_t v_mask = b_mask << a_file;
-
-  return (h_mask | v_mask);
+static bitboard_t get_rook_moves(const struct position *position,
+                                 enum square square) {
+  return rook_attacks(square, position->total_a);
 }
 
 /* Return a bitboard containing the valid bishop move destinations for a given
  * position, taking into account captures and blockages by other pieces. For
  * simplicity, include moves where bishops can capture their own side's pieces
  * (these are filtered out elsewhere). */
-bitboard_t get_bishop_moves(struct position *position, enum square a_square) {
-  /*
-   * Move generation for bishops is similar to rooks, but with sliding move
-   * calculations performed on the 45-degree-rotated C- and D-stacks.
-   * Calculation of shifts and masks is more complicated because the board
-   * is diamond-shaped from these perspectives, so the ranks are of different
-   * lengths.  Lookup tables are used to get the mask and shift used to isolate
-   * the rank, and also to get the bitboard of the moves and the amount it needs
-   * to be shifted.
-   */
-  int c_shift = shift_c[a_square];
-  rank_t c_mask = mask_c[a_square];
-  int c_file = square_a2c[a_square] - c_shift;
-  rank_t c_occ = (rank_t)((position->total_c) >> c_shift) & c_mask;
-  rank_t c_moves = permitted_slide_moves[c_file][c_occ] & c_mask;
-  bitboard_t c_ret = occ_c2a[c_moves] << shift_c2a[a_square];
-
-  int d_shift = shift_d[a_square];
-  rank_t d_mask = mask_d[a_square];
-  int d_file = square_a2d[a_square] - d_shift;
-  rank_t d_occ = (rank_t)((position->total_d) >> d_shift) & d_mask;
-  rank_t d_moves = permitted_slide_moves[d_file][d_occ] & d_mask;
-  bitboard_t d_ret = occ_d2a[d_moves] << shift_d2a[a_square];
-
-  return (c_ret | d_ret);
+static bitboard_t get_bishop_moves(const struct position *position,
+                                   enum square square) {
+  return bishop_attacks(square, position->total_a);
 }
 
-/* Return a bitboard containing the valid king move destinations for a given
-   position, including any castling destinations. */
-bitboard_t get_king_moves(struct position *position, enum square from,
-                          enum player player) {
-  /*
-   * Non-castling king moves are taken from a lookup table, removing any that
-   * would lead into check.  These are returned if there are no castling rights
-   * or the king is under attack.  Otherwise, for each board side with castling
-   * rights, there is a search for any occupied squares which would block the
-   * rook from sliding, then any squares under attack which would block the king
-   * from sliding.  If there are none, castling destinations are added to the
-   * set of moves.
-   */
-  bitboard_t moves = king_moves[from] & ~position->claim[opponent[player]];
-
-  if (!(position->castling_rights & castling_rights[player][BOTHSIDES]) ||
-      get_attacks(position, from, opponent[player])) {
-    return moves;
-  }
-
+/* Return a bitboard containing the castling destinations of the king of
+ * `player`, which is not in check.  For each board side with castling rights,
+ * there is a search for any occupied squares which would block the rook from
+ * sliding, then any squares under attack which would block the king from
+ * sliding. */
+static bitboard_t get_castling_moves(const struct position *position,
+                                     enum player player) {
+  bitboard_t moves = 0;
   bitboard_t all = position->total_a;
   for (int side = 0; side < 2; side++) {
     if (!(position->castling_rights & castling_rights[player][side])) {
@@ -261,10 +145,30 @@ bitboard_t get_king_moves(struct position *position, enum square from,
   return moves;
 }
 
-/* Return a bitboard containing the set of all squares with pieces that
- * can attack a given target square, for a given attacking player. */
-bitboard_t get_attacks(const struct position *position, enum square target,
-                       enum player attacking) {
+/* Return a bitboard containing the valid king move destinations for a given
+   position, including any castling destinations. */
+static bitboard_t get_king_moves(const struct position *position,
+                                 enum square from, enum player player) {
+  /*
+   * Non-castling king moves are taken from a lookup table, removing any that
+   * would lead into check.  These are returned if there are no castling rights
+   * or the king is under attack.  Otherwise, castling destinations are added.
+   */
+  bitboard_t moves = king_moves[from] & ~position->claim[opponent[player]];
+
+  if (!(position->castling_rights & castling_rights[player][BOTHSIDES]) ||
+      get_attacks(position, from, opponent[player])) {
+    return moves;
+  }
+  return moves | get_castling_moves(position, player);
+}
+
+/* Return a bitboard containing the set of all squares with pieces of player
+ * `attacking` which attack `target`, given the set of occupied squares
+ * `occupied`.  Whatever is on `target` is ignored, so this also finds the
+ * defenders of a piece. */
+bitboard_t get_attackers(const struct position *position, enum square target,
+                         enum player attacking, bitboard_t occupied) {
   /*
    * This calculation works on the principle that attacking moves are
    * reciprocal, e.g. if a hypothetical knight at the target square could
@@ -273,31 +177,253 @@ bitboard_t get_attacks(const struct position *position, enum square target,
    * here to get attackers for all piece types.
    */
   bitboard_t attacks = 0;
-  bitboard_t target_mask = square2bit[target];
   int base = attacking * N_PIECE_T;
 
+  attacks = pawn_takes[opponent[attacking]][target] & position->a[base + PAWN];
+  attacks |= knight_moves[target] & position->a[base + KNIGHT];
+  attacks |= king_moves[target] & position->a[base + KING];
+  bitboard_t queens = position->a[base + QUEEN];
+  attacks |= rook_attacks(target, occupied) &
+             (position->a[base + ROOK] | queens);
+  attacks |= bishop_attacks(target, occupied) &
+             (position->a[base + BISHOP] | queens);
+  return attacks & occupied;
+}
+
+/* Return a bitboard containing the set of all squares with pieces that
+ * can attack a given target square, for a given attacking player. */
+bitboard_t get_attacks(const struct position *position, enum square target,
+                       enum player attacking) {
   /* Check player is not trying to attack own piece (checking an empty square is
    * ok because it needs to be done for castling) */
   ASSERT(position->piece_at[target] == EMPTY ||
          piece_player[(int)position->piece_at[target]] != attacking);
 
-  attacks = pawn_takes[opponent[attacking]][target] & position->a[base + PAWN];
-  attacks |= knight_moves[target] & position->a[base + KNIGHT];
-  attacks |= king_moves[target] & position->a[base + KING];
-  bitboard_t sliders = position->a[base + ROOK] | position->a[base + BISHOP] |
-                       position->a[base + QUEEN];
-  while (sliders) {
-    bitboard_t attacker = take_next_bit_from(&sliders);
-    if (target_mask &
-        position->moves[(int)position->index_at[bit2square(attacker)]])
-      attacks |= attacker;
+  return get_attackers(position, target, attacking, position->total_a);
+}
+
+/* Static exchange evaluation.  Return the material gained by the side making
+ * `move`, assuming both sides then keep recapturing on the destination square
+ * with their least valuable attacker, and may stop whenever continuing would
+ * lose material. */
+score_t see(const struct position *position, move_t move) {
+  /*
+   * A swap list is built with the gain for each capture in the sequence,
+   * relative to the side making it.  After each capture, the capturing piece is
+   * removed from the occupancy and the attackers are recalculated, so that
+   * sliders behind it (x-rays) join in.  The list is then scanned backwards,
+   * with each side choosing whether to make its capture or stand pat.
+   */
+  static const enum piece order[N_PIECE_T] = {PAWN,   KNIGHT, BISHOP,
+                                              ROOK,   QUEEN,  KING};
+  score_t gain[N_PIECES + 1];
+  enum square from = move_from(move);
+  enum square to = move_to(move);
+  enum piece promotion = move_promotion(move);
+  bitboard_t occupied = position->total_a;
+  enum player player = position->turn;
+  int attacker = piece_type[(int)position->piece_at[from]];
+  int depth = 0;
+
+  /* The first capture, which may be en-passant or promote */
+  if (position->piece_at[to] != EMPTY) {
+    gain[0] = piece_weights[piece_type[(int)position->piece_at[to]]];
+  } else if (attacker == PAWN && (square2bit[to] & position->en_passant)) {
+    gain[0] = piece_weights[PAWN];
+    occupied &= ~square2bit[(player == WHITE) ? to - 8 : to + 8];
+  } else {
+    gain[0] = 0;
   }
-  return attacks;
+  if (promotion > PAWN) {
+    gain[0] += piece_weights[promotion] - piece_weights[PAWN];
+    attacker = promotion;
+  }
+  bitboard_t from_mask = square2bit[from];
+
+  for (;;) {
+    /* Remove the last capturing piece and find the next attacker */
+    occupied &= ~from_mask;
+    player = opponent[player];
+    bitboard_t attackers = get_attackers(position, to, player, occupied);
+    if (!attackers) break;
+    int next = KING;
+    for (int i = 0; i < N_PIECE_T; i++) {
+      bitboard_t pieces =
+          attackers & position->a[player * N_PIECE_T + order[i]];
+      if (pieces) {
+        next = order[i];
+        from_mask = pieces & (0ull - pieces);
+        break;
+      }
+    }
+
+    /* Speculative gain if the last capturing piece is taken */
+    depth++;
+    gain[depth] = piece_weights[attacker] - gain[depth - 1];
+    attacker = next;
+  }
+
+  while (depth > 0) {
+    depth--;
+    if (-gain[depth + 1] < gain[depth]) gain[depth] = -gain[depth + 1];
+  }
+  return gain[0];
+}
+
+/* Return a bitboard containing the squares that the piece at `square` can move
+ * to, excluding squares occupied by its own side.  This is calculated directly
+ * without using or updating the cached moves in `position`.  For pieces other
+ * than kings, it is the same as the cached moves.  For kings, castling and
+ * squares claimed by the opponent are not considered, because these need the
+ * moves of all the opponent's pieces. */
+bitboard_t get_piece_moves(const struct position *position,
+                           enum square square) {
+  int piece = position->piece_at[square];
+  enum player player = piece_player[piece];
+  bitboard_t moves;
+  switch (piece_type[piece]) {
+    case PAWN:
+      moves = get_pawn_moves(position, square, player);
+      break;
+    case ROOK:
+      moves = get_rook_moves(position, square);
+      break;
+    case KNIGHT:
+      moves = knight_moves[square];
+      break;
+    case BISHOP:
+      moves = get_bishop_moves(position, square);
+      break;
+    case QUEEN:
+      moves = get_bishop_moves(position, square) |
+              get_rook_moves(position, square);
+      break;
+    case KING:
+      moves = king_moves[square];
+      break;
+    default:
+      moves = 0;
+      break;
+  }
+  return moves & ~position->player_a[player];
+}
+
+/* Find the checks and pins against the king of the player to move.  A piece is
+ * pinned if it is the only piece between the king and an opponent's slider
+ * which would attack the king along that line if the piece moved off it. */
+void get_legality(const struct position *position,
+                  struct legality *legality) {
+  enum player player = position->turn;
+  enum player other = opponent[player];
+  bitboard_t kings = position->a[player * N_PIECE_T + KING];
+  legality->king = NO_SQUARE;
+  legality->checkers = 0;
+  legality->targets = ~0ull;
+  legality->pinned = 0;
+  if (!kings) return;
+  enum square king = bit2square(kings);
+  legality->king = king;
+
+  /* Out of a single check, other pieces must take the checker or block.  Out
+   * of a double check, only the king can move. */
+  bitboard_t checkers =
+      get_attackers(position, king, other, position->total_a);
+  legality->checkers = checkers;
+  if (checkers & (checkers - 1))
+    legality->targets = 0;
+  else if (checkers)
+    legality->targets = checkers | between[king][bit2square(checkers)];
+
+  /* Sliders which would attack the king through the player's own pieces */
+  int base = other * N_PIECE_T;
+  bitboard_t opponents = position->player_a[other];
+  bitboard_t queens = position->a[base + QUEEN];
+  bitboard_t snipers =
+      (rook_attacks(king, opponents) & (position->a[base + ROOK] | queens)) |
+      (bishop_attacks(king, opponents) & (position->a[base + BISHOP] | queens));
+  while (snipers) {
+    enum square sniper = bit2square(take_next_bit_from(&snipers));
+    bitboard_t blockers = between[king][sniper] & position->total_a;
+    if (blockers && !(blockers & (blockers - 1)))
+      legality->pinned |= blockers & position->player_a[player];
+  }
+}
+
+/* Return whether an en-passant capture from `from` to the en-passant square
+ * `to_mask` is legal.  It must answer a check by taking the checking pawn or
+ * blocking, and removing both pawns from the rank must not expose the king to
+ * a slider, which the pin masks don't detect. */
+static int is_legal_en_passant(const struct position *position,
+                               const struct legality *legality,
+                               enum square from, bitboard_t to_mask) {
+  enum player player = position->turn;
+  enum square to = bit2square(to_mask);
+  bitboard_t captured = square2bit[(player == WHITE) ? to - N_FILES
+                                                     : to + N_FILES];
+  if (!((to_mask | captured) & legality->targets)) return 0;
+  if (legality->king == NO_SQUARE) return 1;
+
+  int base = opponent[player] * N_PIECE_T;
+  bitboard_t occupied =
+      (position->total_a & ~square2bit[from] & ~captured) | to_mask;
+  bitboard_t queens = position->a[base + QUEEN];
+  return !((rook_attacks(legality->king, occupied) &
+            (position->a[base + ROOK] | queens)) ||
+           (bishop_attacks(legality->king, occupied) &
+            (position->a[base + BISHOP] | queens)));
+}
+
+/* Return a bitboard containing the squares that the piece at `square` can
+ * legally move to, given the checks and pins found by `get_legality` for the
+ * player to move.  Like `get_piece_moves`, this does not use or update the
+ * cached moves in `position`.
+ *
+ * The king can move to any square which is not attacked once it has left its
+ * own square, so that it can't step back along the line of a checking slider,
+ * and can castle if not in check.  Other pieces are limited to the squares
+ * which answer a check, and pinned pieces to the line of the pin. */
+bitboard_t get_legal_moves(const struct position *position,
+                           const struct legality *legality,
+                           enum square square) {
+  int piece = position->piece_at[square];
+  enum player player = piece_player[piece];
+
+  if (piece_type[piece] == KING) {
+    enum player other = opponent[player];
+    bitboard_t occupied = position->total_a & ~square2bit[square];
+    bitboard_t moves = king_moves[square] & ~position->player_a[player];
+    bitboard_t safe = 0;
+    while (moves) {
+      bitboard_t mask = take_next_bit_from(&moves);
+      if (!get_attackers(position, bit2square(mask), other, occupied))
+        safe |= mask;
+    }
+    if (!legality->checkers &&
+        (position->castling_rights & castling_rights[player][BOTHSIDES]))
+      safe |= get_castling_moves(position, player);
+    return safe;
+  }
+
+  if (!legality->targets) return 0;
+  bitboard_t moves = get_piece_moves(position, square);
+  bitboard_t en_passant = 0;
+  if (piece_type[piece] == PAWN) {
+    en_passant = moves & position->en_passant;
+    moves &= ~en_passant;
+  }
+  moves &= legality->targets;
+  if (legality->pinned & square2bit[square])
+    moves &= line_through[legality->king][square];
+  if (en_passant &&
+      is_legal_en_passant(position, legality, square, en_passant))
+    moves |= en_passant;
+  return moves;
 }
 
 /* Pre-calculate bitboards within the given position struct containing the set
    of all squares that each piece can move to.  Also pre-calculate a claim for
-   each player.  This is called after a move is made. */
+   each player.  This is called the first time the moves of a position are
+   needed, through `get_moves` or `get_claim`. */
 void calculate_moves(struct position *position) {
   /*
    * For each piece apart from kings, moves are calculated for the piece
@@ -306,8 +432,7 @@ void calculate_moves(struct position *position) {
    * which is the set of all squares that the side could potentially move to by
    * capture.  For pawns, the added claim is only the capturing moves, for other
    * pieces, all moves are added.  King moves are handled last, because
-   * generation depends on `get_attacks` which requires move information for all
-   * other pieces.
+   * generation depends on the claim of the other side.
    */
   position->claim[WHITE] = 0;
   position->claim[BLACK] = 0;
@@ -322,33 +447,7 @@ void calculate_moves(struct position *position) {
     if (piece_type[piece] == KING) continue;
 
     enum player player = piece_player[piece];
-    bitboard_t moves;
-    switch (piece_type[piece]) {
-      case PAWN:
-        moves = get_pawn_moves(position, square, player);
-        break;
-      case ROOK:
-        moves = get_rook_moves(position, square);
-        break;
-      case KNIGHT:
-        moves = knight_moves[square];
-        break;
-      case BISHOP:
-        moves = get_bishop_moves(position, square);
-        break;
-      case QUEEN:
-        moves = get_bishop_moves(position, square) |
-                get_rook_moves(position, square);
-        break;
-      case KING:
-        moves = get_king_moves(position, square, player);
-        break;
-      default:
-        moves = 0;
-        break;
-    }
-
-    moves &= ~position->player_a[player];
+    bitboard_t moves = get_piece_moves(position, square);
     position->moves[index] = moves;
 
     if (piece_type[piece] != PAWN) {
@@ -375,82 +474,134 @@ void calculate_moves(struct position *position) {
     position->moves[index] = moves;
     position->claim[player] |= moves;
   }
+  position->moves_id = position->id;
 }
 
-/* Initialise the module and pre-calculated lookup tables. */
-void init_moves(void) {
+/* Return the set of squares that a rook (`diagonal` = 0) or bishop
+ * (`diagonal` = 1) on `square` attacks, given the set of occupied squares. */
+bitboard_t slide_attacks(enum square square, bitboard_t occupied,
+                         int diagonal) {
   /*
-   * Position-indexed tables
+   * Step along each of the four rays in turn, adding each square, until the
+   * edge of the board or an occupied square is reached.  The occupied square is
+   * included because it may be captured.
    */
-  for (enum square square = 0; square < N_SQUARES; square++) {
-    int mirror = (square / 8) * 8 + (7 - square % 8);
-    shift_d[square] = shift_c[mirror];
-    mask_d[square] = mask_c[mirror];
+  static const int steps[2][4][2] = {
+      {{1, 0}, {-1, 0}, {0, 1}, {0, -1}},
+      {{1, 1}, {1, -1}, {-1, 1}, {-1, -1}},
+  };
+  bitboard_t attacks = 0;
+  for (int dir = 0; dir < 4; dir++) {
+    int rank = square / N_FILES + steps[diagonal][dir][0];
+    int file = square % N_FILES + steps[diagonal][dir][1];
+    while (rank >= 0 && rank < N_RANKS && file >= 0 && file < N_FILES) {
+      bitboard_t mask = 1ull << (rank * N_FILES + file);
+      attacks |= mask;
+      if (occupied & mask) break;
+      rank += steps[diagonal][dir][0];
+      file += steps[diagonal][dir][1];
+    }
   }
+  return attacks;
+}
 
+#if !defined(USE_PEXT)
+/* Xorshift PRNG used to search for magic numbers.  Fixed seeds keep the tables
+ * the same from run to run.  The seeds for each rank are known to find magics
+ * after few attempts, which keeps start-up fast. */
+static const bitboard_t magic_seeds[N_RANKS] = {728,   10316, 55013, 32803,
+                                                12281, 15100, 16645, 255};
+static bitboard_t magic_random(bitboard_t *state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 2685821657736338717ull;
+}
+#endif
+
+/* Fill in the slider lookups in `magics` and the attack sets in `table`. */
+static void init_sliders(struct magic *magics, bitboard_t *table,
+                         int diagonal) {
   /*
-   * Bitboard occupancies
-   *
-   * Generate bitboard lookup tables which convert rank occupancy into a
-   * vertical or diagonal bitboard in A-plane.
+   * For each square, the relevant occupancy mask is the set of squares
+   * attacked on an empty board, without the edges of the board, because a
+   * piece on the last square of a ray doesn't block anything.  Every subset of
+   * the mask is enumerated using the carry-rippler trick, and the attack set
+   * for each is calculated by `slide_attacks`.  For PEXT, the subset's index is
+   * just its bits packed together.  For magics, random sparse multipliers are
+   * tried until one maps every subset to an index with no destructive
+   * collisions (two subsets which map to the same index must have the same
+   * attack set).  `epoch` records which attempt wrote each index so that the
+   * table doesn't have to be cleared between attempts.
    */
+  static bitboard_t occupancy[4096], reference[4096];
+  bitboard_t *attacks = table;
 
-  for (int i = 0; i < 256; i++) {
-    occ_b2a[i] = 0;
-    occ_c2a[i] = 0;
-    occ_d2a[i] = 0;
-    for (int bit = 0; bit < 8; bit++) {
-      if (i & (1 << bit)) {
-        occ_b2a[i] |= square2bit[square_a2b[bit]];
-        occ_c2a[i] |= square2bit[bit * 7];
-        occ_d2a[i] |= square2bit[bit * 9];
+  for (enum square square = 0; square < N_SQUARES; square++) {
+    bitboard_t rank_edges = 0xff000000000000ffull & ~(0xffull << (square & ~7));
+    bitboard_t file_edges =
+        0x8181818181818181ull & ~(0x0101010101010101ull << (square & 7));
+    struct magic *entry = &magics[square];
+    entry->mask =
+        slide_attacks(square, 0, diagonal) & ~(rank_edges | file_edges);
+    entry->shift = 64 - pop_count(entry->mask);
+    entry->attacks = attacks;
+
+    int size = 0;
+    bitboard_t occupied = 0;
+    do {
+      occupancy[size] = occupied;
+      reference[size] = slide_attacks(square, occupied, diagonal);
+      size++;
+      occupied = (occupied - entry->mask) & entry->mask;
+    } while (occupied);
+
+#if defined(USE_PEXT)
+    entry->magic = 0;
+    for (int i = 0; i < size; i++) {
+      attacks[magic_index(entry, occupancy[i])] = reference[i];
+    }
+#else
+    static int epoch[4096];
+    static int attempt = 0;
+    bitboard_t seed = magic_seeds[square / N_FILES];
+    int i = 0;
+    while (i < size) {
+      do {
+        entry->magic = magic_random(&seed) & magic_random(&seed) &
+                       magic_random(&seed);
+      } while (pop_count((entry->mask * entry->magic) >> 56) < 6);
+
+      attempt++;
+      for (i = 0; i < size; i++) {
+        unsigned index = magic_index(entry, occupancy[i]);
+        if (epoch[index] < attempt) {
+          epoch[index] = attempt;
+          attacks[index] = reference[i];
+        } else if (attacks[index] != reference[i]) {
+          break;
+        }
       }
     }
+#endif
+    attacks += size;
   }
+}
 
+/* Initialise the module and pre-calculated lookup tables. */
+void init_moves(void) {
   /*
-   * Sliding destinations
+   * Sliding moves
    *
-   * Generate an 8 x 256 lookup table of permitted sliding destinations within a
-   * single rank.  For each square and rank occupancy, get the set of all pieces
-   * to the left of the target square, find the first occupied square to the
-   * left of the target square, then get the set of all squares to the left of
-   * the first occupied square, which are impossible to move to by slide move.
-   * Do the same for pieces to the right of the square, and combine and invert
-   * them to produce the set of permitted sliding destinations.  The first
-   * occupied square is found using CTZ/CLZ operations, with a special case for
-   * no occupied squares, because these operations are undefined for zero.  For
-   * the CLZ operation, the number of leading zeros must be reduced from the
-   * word size down to the rank size.
+   * Generate the lookup tables for rook and bishop attacks.  Queen attacks are
+   * the union of the two.
    */
-
-  for (enum square square = 0; square < 8; square++) {
-    unsigned int rank;
-    for (rank = 0; rank < 256; rank++) {
-      unsigned int l_squares = 0xff << (square + 1);
-      unsigned int l_pieces = l_squares & rank;
-      unsigned int l_impossible;
-      if (l_pieces) {
-        int l_first_occupied = ctz(l_pieces);
-        l_impossible = 0xff << (l_first_occupied + 1);
-      } else {
-        l_impossible = 0;
-      }
-
-      unsigned int r_squares = 0xff >> (8 - square);
-      unsigned int r_pieces = r_squares & rank;
-      unsigned int r_impossible;
-      if (r_pieces) {
-        int r_first_occupied =
-            sizeof(unsigned long long) * 8 - 1 - clz(r_pieces);
-        r_impossible = 0xff >> (8 - r_first_occupied);
-      } else {
-        r_impossible = 0;
-      }
-
-      permitted_slide_moves[square][rank] = ~(r_impossible | l_impossible);
-    }
-  }
+  init_sliders(rook_magics, rook_table, 0);
+  init_sliders(bishop_magics, bishop_table, 1);
+  ASSERT(rook_magics[H8].attacks + (1 << (64 - rook_magics[H8].shift)) ==
+         rook_table + ROOK_TABLE_SIZE);
+  ASSERT(bishop_magics[H8].attacks + (1 << (64 - bishop_magics[H8].shift)) ==
+         bishop_table + BISHOP_TABLE_SIZE);
 
   /*
    * Knight and King Moves
@@ -542,4 +693,25 @@ void init_moves(void) {
       pawn_takes[player][square] = take;
     }
   }
+
+  /*
+   * Lines between squares
+   *
+   * Two squares are aligned if a rook or bishop on one attacks the other on an
+   * empty board.  The squares between them are those attacked from both when
+   * each blocks the other, and the line through them is the intersection of
+   * their attacks on an empty board, which excludes the squares themselves.
+   */
+  for (enum square a = 0; a < N_SQUARES; a++) {
+    for (enum square b = 0; b < N_SQUARES; b++) {
+      for (int diagonal = 0; diagonal < 2; diagonal++) {
+        bitboard_t from_a = slide_attacks(a, 0, diagonal);
+        if (a == b || !(from_a & square2bit[b])) continue;
+        between[a][b] = slide_attacks(a, square2bit[b], diagonal) &
+                        slide_attacks(b, square2bit[a], diagonal);
+        line_through[a][b] = (from_a & slide_attacks(b, 0, diagonal)) |
+                             square2bit[a] | square2bit[b];
+      }
+    }
+  }
 }
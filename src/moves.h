@@ -4,8 +4,81 @@
 #ifndef MOVES_H
 #define MOVES_H
 
-struct position;
+#include "evaluate.h"
+#include "position.h"
 
-void calculate_moves(struct position *position);
+#if defined(USE_PEXT)
+#  include <immintrin.h>
+#endif
+
+/* Slider attack lookup for one square.  The relevant occupancy is the set of
+ * squares on the piece's rays, excluding the edge of the board, which is
+ * reduced to an index into the table of attack sets, either by a magic
+ * multiply and shift or by a PEXT instruction. */
+struct magic {
+  bitboard_t mask;     /* Relevant occupancy squares */
+  bitboard_t magic;    /* Multiplier for magic indexing */
+  bitboard_t *attacks; /* Attack sets for this square */
+  int shift;           /* 64 - number of bits in the index */
+};
+
+extern struct magic rook_magics[N_SQUARES];
+extern struct magic bishop_magics[N_SQUARES];
+
+/* Name of the compiled slider backend */
+extern const char slider_backend[];
+
+/* Return the index into the attack table of `entry` for the given occupancy */
+static inline unsigned magic_index(const struct magic *entry,
+                                   bitboard_t occupied) {
+#if defined(USE_PEXT)
+  return (unsigned)_pext_u64(occupied, entry->mask);
+#else
+  return (unsigned)(((occupied & entry->mask) * entry->magic) >> entry->shift);
+#endif
+}
+
+/* Return the set of squares that a rook on `square` attacks, given the set of
+ * all occupied squares */
+static inline bitboard_t rook_attacks(enum square square, bitboard_t occupied) {
+  const struct magic *entry = &rook_magics[square];
+  return entry->attacks[magic_index(entry, occupied)];
+}
+
+/* Return the set of squares that a bishop on `square` attacks, given the set of
+ * all occupied squares */
+static inline bitboard_t bishop_attacks(enum square square,
+                                        bitboard_t occupied) {
+  const struct magic *entry = &bishop_magics[square];
+  return entry->attacks[magic_index(entry, occupied)];
+}
+
+/* Return the set of squares that a slider attacks by walking along each ray
+ * until it is blocked.  Used to build the lookup tables, and as a reference. */
+bitboard_t slide_attacks(enum square square, bitboard_t occupied, int diagonal);
+
+/* Checks and pins against the king of the player to move, found once for a
+ * position by `get_legality` so that only legal moves are generated */
+struct legality {
+  enum square king;    /* NO_SQUARE if there is no king */
+  bitboard_t checkers; /* Opponent's pieces giving check */
+  bitboard_t targets;  /* Squares which answer the check for pieces other than
+                          the king - all squares if not in check, and none in
+                          double check */
+  bitboard_t pinned;   /* Player's pieces pinned to the king */
+};
+
+extern bitboard_t between[N_SQUARES][N_SQUARES];
+extern bitboard_t line_through[N_SQUARES][N_SQUARES];
+
+bitboard_t get_attackers(const struct position *position, enum square target,
+                         enum player attacking, bitboard_t occupied);
+score_t see(const struct position *position, move_t move);
+bitboard_t get_piece_moves(const struct position *position,
+                           enum square square);
+void get_legality(const struct position *position, struct legality *legality);
+bitboard_t get_legal_moves(const struct position *position,
+                           const struct legality *legality,
+                           enum square square);
 
 #endif
@@ -7,6 +7,7 @@
 #include <ctype.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "buildinfo/buildinfo.h"
 #include "commands.h"
@@ -23,14 +24,17 @@
  * Arrays of options are declared in other modules
  */
 extern const struct options eval_opts;
+extern const struct options search_opts;
+extern const struct options tt_opts;
 extern const struct options ui_opts;
 
 /* Array of options from each module */
-const struct options *const module_opts[] = {&eval_opts};
+const struct options *const module_opts[] = {&eval_opts, &search_opts,
+                                             &tt_opts};
 enum { N_MODULES = sizeof(module_opts) / sizeof(module_opts[0]) };
 
-/* Names which are passed to XBoard describing option types - see definition of
- * `enum option_type` */
+/* Names which are passed to XBoard or a UCI GUI describing option types - see
+ * definition of `enum option_type` */
 const char option_controls[N_OPTION_T][10] = {"check",  "spin",   "string",
                                               "string", "button", "combo"};
 
@@ -77,6 +81,51 @@ void list_options(void) {
   }
 }
 
+/* List the available options in response to a `uci` request */
+void list_uci_options(void) {
+  for (int i = 0; i < N_MODULES; i++) {
+    const struct options *const mod = module_opts[i];
+    for (int j = 0; j < mod->n_opts; j++) {
+      const struct option *opt = &mod->opts[j];
+      printf("option name %s type %s", opt->name, option_controls[opt->type]);
+      switch (opt->type) {
+        case SPIN_OPT:
+          /* e.g. `option name foo type spin default 50 min 1 max 100\n` */
+          printf(" default %d min %d max %d", *opt->value.integer, opt->min,
+                 opt->max);
+          break;
+        case BOOL_OPT:
+          /* e.g. `option name foo type check default true\n` */
+          printf(" default %s", *opt->value.integer ? "true" : "false");
+          break;
+        case INT_OPT:
+          /* e.g. `option name foo type string default 100\n` */
+          printf(" default %d", *opt->value.integer);
+          break;
+        case TEXT_OPT:
+          /* e.g. `option name foo type string default abcde\n` */
+          printf(" default %s", opt->value.text[0] ? opt->value.text
+                                                    : "<empty>");
+          break;
+        case CMD_OPT:
+          /* e.g. `option name foo type button\n` */
+          break;
+        case COMBO_OPT:
+          /* e.g. `option name foo type combo default opt1 var opt1 var opt2\n`
+           */
+          printf(" default %s",
+                 opt->combo_vals->vals[*opt->value.integer].name);
+          for (int k = 0; k < opt->combo_vals->n_vals; k++)
+            printf(" var %s", opt->combo_vals->vals[k].name);
+          break;
+        default:
+          break;
+      }
+      printf("\n");
+    }
+  }
+}
+
 /* Get arguments for an option, delimited by \n */
 static inline const char *get_option_args(const struct option *opt) {
   switch (opt->type) {
@@ -188,6 +237,34 @@ int set_option(struct engine *engine, const char *name) {
   return 0;
 }
 
+/* Set an option from `arg` in the form "name=value", as given on the command
+ * line of a bench or test program.  Return zero on success. */
+int set_option_arg(struct engine *engine, const char *arg) {
+  char name[NAME_LENGTH];
+  const char *val_txt = strchr(arg, '=');
+  if (!val_txt || val_txt - arg >= NAME_LENGTH) return 1;
+  memcpy(name, arg, val_txt - arg);
+  name[val_txt - arg] = 0;
+  return set_option_value(engine, name, val_txt + 1);
+}
+
+/* Set the option called `name` to the value in `val_txt`.  Return zero on
+ * success. */
+int set_option_value(struct engine *engine, const char *name,
+                     const char *val_txt) {
+  for (int i = 0; i < N_MODULES; i++) {
+    const struct options *const mod = module_opts[i];
+    for (int j = 0; j < mod->n_opts; j++) {
+      const struct option *opt = &mod->opts[j];
+      if (strcmp(name, opt->name) != 0) continue;
+      int val = 0;
+      if (interpret_option_args(opt, engine, val_txt, &val)) return 1;
+      return validate_option_args(opt, val_txt, val);
+    }
+  }
+  return 1;
+}
+
 /*
  * Features interface to XBoard
  *
@@ -218,6 +295,8 @@ const struct feature features[] = {
     {"setboard", INT_FEAT, 1, ""},      /* setboard command is implemented */
     {"name", INT_FEAT, 0, ""}, /* We don't care about opponent engine's name*/
     {"ping", INT_FEAT, 0, ""}, /* `ping` is not implemented */
+    {"smp", INT_FEAT, 1, ""},  /* `cores` sets the number of search threads */
+    {"memory", INT_FEAT, 1, ""}, /* `memory` sets the hash table size */
     {"variants", TEXT_FEAT, 0,
      "normal"}, /* The only available variant is normal FIDE chess. */
     {"done", INT_FEAT, 1, ""}, /* End of features */
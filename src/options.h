@@ -62,5 +62,8 @@ void list_features(void);
 void feature_accepted(const char *name);
 void list_options(void);
 int set_option(struct engine *e, const char *name);
+int set_option_arg(struct engine *e, const char *arg);
+void list_uci_options(void);
+int set_option_value(struct engine *e, const char *name, const char *val_txt);
 
 #endif /* OPTIONS_H */
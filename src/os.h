@@ -66,4 +66,19 @@ void set_console_black_piece(void);
 unsigned int get_process_id(void);
 void print_backtrace();
 
+/* Threads of execution, used for multi-threaded search */
+struct thread;
+typedef void (*thread_fn)(void *arg);
+struct thread *thread_create(thread_fn fn, void *arg);
+void thread_join(struct thread *thread);
+
+/* Mutual exclusion with signalling, used to pass input between threads */
+struct lock;
+struct lock *lock_create(void);
+void lock_destroy(struct lock *lock);
+void lock_acquire(struct lock *lock);
+void lock_release(struct lock *lock);
+void lock_wait(struct lock *lock);
+void lock_notify(struct lock *lock);
+
 #endif /* OS_H */
@@ -0,0 +1,317 @@
+/*
+ *   Perft - move generator performance test
+ *
+ *   A standard test to perform high-level validation of move generation by
+ *   recursively generating a tree of all moves for a given position to a given
+ *   depth, and counting the total moves and features (captured, en-passant,
+ *   castled, etc.) at leaf nodes, which can be compared to reference data.
+ *
+ *   The moves from the root are shared between a pool of worker threads, each
+ *   with its own copy of the position, which take the next unsearched root move
+ *   until there are none left.  The number of workers is set by `cores` or the
+ *   UCI "Threads" option.  Subtrees which are reached by more than one path are
+ *   only counted once, by storing their totals in a table shared between the
+ *   workers.  Only legal moves are generated, so at the last ply, when only
+ *   the number of nodes is needed, it is the number of moves generated, without
+ *   making any of them.
+ */
+
+#include "perft.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "io.h"
+#include "movegen.h"
+#include "os.h"
+#include "search.h"
+
+enum {
+  PERFT_TT_MIN_DEPTH = 2,  /* Shallower subtrees are not worth storing */
+  PERFT_TT_BUCKET_SIZE = 2 /* Entries per bucket */
+};
+
+/* Table entry - the totals for a subtree.  `key` is the key of the position
+ * and depth xor a checksum of the other fields, so that an entry which is
+ * read while another thread is writing it does not match. */
+struct perft_entry {
+  hash_t key;
+  int depth;
+  struct perft_stats data;
+};
+
+/* The first entry in a bucket keeps the deepest subtree and the second is
+ * always replaced */
+struct perft_bucket {
+  struct perft_entry entries[PERFT_TT_BUCKET_SIZE];
+};
+
+/* Table shared by all workers, allocated to the size of the "Hash" option for
+ * each perft command and freed afterwards */
+static struct perft_bucket *perft_tt;
+static unsigned long long perft_tt_n_buckets;
+
+/* Everything the workers share */
+struct perft_job {
+  int depth;
+  int counts_only;   /* Count leaf nodes only, not their features */
+  struct lock *lock; /* Protects `next` */
+  int next;          /* Next root move to take */
+  int n_moves;
+  move_t moves[N_MOVES];
+  struct perft_stats results[N_MOVES];
+};
+
+/* A worker thread and its private copy of the position */
+struct perft_worker {
+  struct perft_job *job;
+  struct position position;
+  struct thread *thread;
+};
+
+/* Allocate the table, or leave it empty if there is not enough memory */
+static void perft_tt_alloc(void) {
+  unsigned long long bytes = (unsigned long long)tt_size_mb * 1024ull * 1024ull;
+  perft_tt_n_buckets = 1;
+  while (perft_tt_n_buckets * 2 * sizeof(struct perft_bucket) <= bytes)
+    perft_tt_n_buckets *= 2;
+  perft_tt = (struct perft_bucket *)calloc(perft_tt_n_buckets,
+                                           sizeof(struct perft_bucket));
+}
+
+static void perft_tt_free(void) {
+  free(perft_tt);
+  perft_tt = 0;
+}
+
+/* Key for a subtree.  The Zobrist hash does not include the en-passant square,
+ * so it is added here, along with the depth and whether features are counted,
+ * which change the totals for the same position. */
+static hash_t perft_key(const struct position *position, int depth,
+                        int counts_only) {
+  hash_t key = position->hash;
+  if (position->en_passant)
+    key ^= en_passant_key[bit2square(position->en_passant) % 8];
+  return key ^ (hash_t)(depth * 2 + counts_only) * 0x9e3779b97f4a7c15ull;
+}
+
+static hash_t perft_checksum(int depth, const struct perft_stats *data) {
+  return (hash_t)depth ^ data->moves ^ ((hash_t)data->captures << 8) ^
+         ((hash_t)data->promotions << 16) ^ ((hash_t)data->ep_captures << 24) ^
+         ((hash_t)data->castles << 32) ^ ((hash_t)data->checks << 40) ^
+         ((hash_t)data->checkmates << 48);
+}
+
+/* Find the totals for a subtree.  Return 1 if found. */
+static int perft_tt_probe(hash_t key, int depth, struct perft_stats *data) {
+  if (!perft_tt) return 0;
+  struct perft_bucket *bucket = &perft_tt[key & (perft_tt_n_buckets - 1)];
+  for (int i = 0; i < PERFT_TT_BUCKET_SIZE; i++) {
+    struct perft_entry entry = bucket->entries[i];
+    if (entry.depth == depth &&
+        (entry.key ^ perft_checksum(entry.depth, &entry.data)) == key) {
+      *data = entry.data;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Store the totals for a subtree */
+static void perft_tt_store(hash_t key, int depth,
+                           const struct perft_stats *data) {
+  if (!perft_tt) return;
+  struct perft_bucket *bucket = &perft_tt[key & (perft_tt_n_buckets - 1)];
+  struct perft_entry *entry = &bucket->entries[0];
+  if (entry->depth > depth) entry = &bucket->entries[1];
+  entry->depth = depth;
+  entry->data = *data;
+  entry->key = key ^ perft_checksum(depth, data);
+}
+
+/* Count the features of a leaf node reached by a move with `result`.  Test for
+ * check in the position, and if in check, for checkmate. */
+static void perft_leaf(struct perft_stats *data, struct position *position,
+                       moveresult_t result) {
+  data->moves++;
+  if (result & CAPTURED) data->captures++;
+  if (result & EN_PASSANT) data->ep_captures++;
+  if (result & CASTLED) data->castles++;
+  if (result & PROMOTED) data->promotions++;
+
+  if (in_check(position)) {
+    data->checks++;
+    if (!has_legal_move(position)) data->checkmates++;
+  }
+}
+
+/* Add the totals in `add` to `data` */
+static void perft_add(struct perft_stats *data, const struct perft_stats *add) {
+  data->moves += add->moves;
+  data->captures += add->captures;
+  data->promotions += add->promotions;
+  data->castles += add->castles;
+  data->checks += add->checks;
+  data->checkmates += add->checkmates;
+  data->ep_captures += add->ep_captures;
+}
+
+/* Total the subtree of `position` to `depth`, which was reached by a move with
+ * `result`.  Moves are made and unmade in place, so `position` is unchanged on
+ * return. */
+static void perft(struct perft_stats *data, struct position *position,
+                  int depth, moveresult_t result, int counts_only) {
+  memset(data, 0, sizeof(*data));
+
+  if (depth == 0) {
+    if (counts_only)
+      data->moves = 1;
+    else
+      perft_leaf(data, position, result);
+    return;
+  }
+
+  hash_t key = 0;
+  if (depth >= PERFT_TT_MIN_DEPTH) {
+    key = perft_key(position, depth, counts_only);
+    if (perft_tt_probe(key, depth, data)) return;
+  }
+
+  /* Generate the legal moves.  At the last ply, the number of moves is the
+   * node count, and features are counted here after making each move.
+   * Otherwise, make each move, recurse into `perft`, and total the data for
+   * all moves. */
+  move_t moves[N_MOVES];
+  int n_moves = generate_legal_moves(position, moves);
+  if (depth == 1 && counts_only) {
+    data->moves = n_moves;
+    return;
+  }
+  struct move move;
+  struct undo undo;
+  struct perft_stats next_data;
+  for (int i = 0; i < n_moves; i++) {
+    decode_move(moves[i], &move);
+    make_move_save(position, &move, &undo);
+    change_player(position);
+    if (depth == 1) {
+      perft_leaf(data, position, move.result);
+    } else {
+      perft(&next_data, position, depth - 1, move.result, counts_only);
+      perft_add(data, &next_data);
+    }
+    unmake_move(position, &undo);
+  }
+
+  if (depth >= PERFT_TT_MIN_DEPTH) perft_tt_store(key, depth, data);
+}
+
+/* Worker entry point - total the subtrees of root moves until there are none
+ * left */
+static void run_worker(void *arg) {
+  struct perft_worker *worker = (struct perft_worker *)arg;
+  struct perft_job *job = worker->job;
+  struct move move;
+  struct undo undo;
+  for (;;) {
+    lock_acquire(job->lock);
+    int i = job->next++;
+    lock_release(job->lock);
+    if (i >= job->n_moves) break;
+    decode_move(job->moves[i], &move);
+    make_move_save(&worker->position, &move, &undo);
+    change_player(&worker->position);
+    perft(&job->results[i], &worker->position, job->depth - 1, move.result,
+          job->counts_only);
+    unmake_move(&worker->position, &undo);
+  }
+}
+
+/* Total the subtree of each legal move from `position` to `depth` into
+ * `job->results`, using `search_threads` workers including this thread.  Return
+ * 0 on success. */
+static int perft_run(struct perft_job *job, const struct position *position,
+                     int depth, int counts_only) {
+  memset(job, 0, sizeof(*job));
+  job->depth = depth;
+  job->counts_only = counts_only;
+
+  job->n_moves = generate_legal_moves(position, job->moves);
+
+  int n_workers = search_threads;
+  if (n_workers > job->n_moves) n_workers = job->n_moves;
+  if (n_workers < 1) n_workers = 1;
+  struct perft_worker *workers =
+      (struct perft_worker *)calloc(n_workers, sizeof(*workers));
+  job->lock = lock_create();
+  if (!workers || !job->lock) {
+    printf("Can't start perft\n");
+    free(workers);
+    if (job->lock) lock_destroy(job->lock);
+    return 1;
+  }
+
+  /* Worker 0 runs on this thread */
+  for (int i = 0; i < n_workers; i++) {
+    workers[i].job = job;
+    copy_position(&workers[i].position, position);
+    if (i > 0) workers[i].thread = thread_create(run_worker, &workers[i]);
+  }
+  run_worker(&workers[0]);
+  for (int i = 1; i < n_workers; i++)
+    if (workers[i].thread) thread_join(workers[i].thread);
+
+  lock_destroy(job->lock);
+  free(workers);
+  return 0;
+}
+
+/* For each move from a given position, perform a perft on the following
+ * position, and report the number of moves. */
+void perft_divide(struct position *position, int depth) {
+  if (depth < 1) return;
+  struct perft_job *job = (struct perft_job *)malloc(sizeof(*job));
+  if (!job) return;
+  perft_tt_alloc();
+  int err = perft_run(job, position, depth, 1);
+  perft_tt_free();
+  if (err) {
+    free(job);
+    return;
+  }
+  unsigned long long total = 0;
+  char buf[8];
+  for (int i = 0; i < job->n_moves; i++) {
+    struct move move;
+    describe_move(position, job->moves[i], &move);
+    format_move_san(buf, &move);
+    printf("%s: %lld\n", buf, job->results[i].moves);
+    total += job->results[i].moves;
+  }
+  printf("\nTotal: %lld\n", total);
+  free(job);
+}
+
+/* Perform multiple perft tests to increasing depths and print the results in a
+ * formatted table. */
+void perft_total(struct position *position, int depth) {
+  struct perft_job *job = (struct perft_job *)malloc(sizeof(*job));
+  if (!job) return;
+  printf("%8s%16s%12s%12s%12s%12s%12s%12s%12s%12s\n", "Depth", "Nodes",
+         "Captures", "E.P.", "Castles", "Promotions", "Checks", "Disco Chx",
+         "Double Chx", "Checkmates");
+  perft_tt_alloc();
+  for (int i = 1; i <= depth; i++) {
+    if (perft_run(job, position, i, 0)) break;
+    struct perft_stats data;
+    memset(&data, 0, sizeof(data));
+    for (int j = 0; j < job->n_moves; j++) perft_add(&data, &job->results[j]);
+    printf("%8d%16lld%12ld%12ld%12ld%12ld%12ld%12s%12s%12ld\n", i, data.moves,
+           data.captures, data.ep_captures, data.castles, data.promotions,
+           data.checks, "X", "X", data.checkmates);
+  }
+  perft_tt_free();
+  free(job);
+}
@@ -0,0 +1,25 @@
+/*
+ *   Perft - move generator performance test
+ */
+
+#ifndef PERFT_H
+#define PERFT_H
+
+#include "position.h"
+
+/* Perft statistics */
+struct perft_stats {
+  unsigned long long moves;
+  unsigned long captures;
+  unsigned long promotions;
+  unsigned long en_passant;
+  unsigned long ep_captures;
+  unsigned long castles;
+  unsigned long checks;
+  unsigned long checkmates;
+};
+
+void perft_total(struct position *position, int depth);
+void perft_divide(struct position *position, int depth);
+
+#endif /* PERFT_H */
@@ -4,6 +4,8 @@
 
 #include "position.h"
 
+#include <stddef.h>
+
 #include "debug.h"
 #include "evaluate.h"
 #include "fen.h"
@@ -18,24 +20,6 @@ void init_moves(void);
 
 /* clang-format off */
 
-/* Mapping from A-square to B-square. Calculated by `init_board`. */
-enum square square_a2b[N_SQUARES];
-
-/* Mapping from A-square to C-square */
-const enum square square_a2c[N_SQUARES] = {
-   0,  1,  3,  6, 10, 15, 21, 28,
-   2,  4,  7, 11, 16, 22, 29, 36,
-   5,  8, 12, 17, 23, 30, 37, 43,
-   9, 13, 18, 24, 31, 38, 44, 49,
-  14, 19, 25, 32, 39, 45, 50, 54,
-  20, 26, 33, 40, 46, 51, 55, 58,
-  27, 34, 41, 47, 52, 56, 59, 61,
-  35, 42, 48, 53, 57, 60, 62, 63
-};
-
-/* Mapping from A-square to D-square. Calculated by `init_board`. */
-enum square square_a2d[N_SQUARES];
-
 /* Rook starting squares */
 const enum square rook_start_square[N_PLAYERS][2] = { { 0, 7 }, { 56, 63 } };
 
@@ -72,10 +56,22 @@ const enum piece start_pieces[N_SQUARES] = {
 /* clang-format on */
 
 const enum player opponent[N_PLAYERS] = {BLACK, WHITE};
+/* Contribution of each piece type to `material_phase`, which falls from
+ * `MAX_MATERIAL_PHASE` towards zero as pieces are exchanged */
+const int phase_weights[N_PIECE_T] = {0, 2, 1, 1, 4, 0};
 bitboard_t _square2bit[N_SQUARES + 1];
 /* Convert square coordinate to bitboard bit */
 bitboard_t *square2bit;
 
+/* Each group of fields in `struct position` starts a cache line */
+STATIC_ASSERT(position_stack, offsetof(struct position, a) == 0);
+STATIC_ASSERT(position_state, offsetof(struct position, hash) == 2 * 64);
+STATIC_ASSERT(position_pieces,
+              offsetof(struct position, piece_square) == 3 * 64);
+STATIC_ASSERT(position_board, offsetof(struct position, piece_at) == 4 * 64);
+STATIC_ASSERT(position_moves, offsetof(struct position, moves) == 6 * 64);
+STATIC_ASSERT(position_size, sizeof(struct position) == 664);
+
 /*
  *  Functions
  */
@@ -89,25 +85,21 @@ static inline void add_piece(struct position *position, enum square square,
   ASSERT(position->piece_at[square] == EMPTY);
   enum piece player = piece_player[piece];
   bitboard_t a_mask = square2bit[square];
-  bitboard_t b_mask = square2bit[square_a2b[square]];
-  bitboard_t c_mask = square2bit[square_a2c[square]];
-  bitboard_t d_mask = square2bit[square_a2d[square]];
   position->a[piece] |= a_mask;
-  position->b[piece] |= b_mask;
-  position->c[piece] |= c_mask;
-  position->d[piece] |= d_mask;
   position->player_a[player] |= a_mask;
-  position->player_b[player] |= b_mask;
-  position->player_c[player] |= c_mask;
-  position->player_d[player] |= d_mask;
   position->total_a |= a_mask;
-  position->total_b |= b_mask;
-  position->total_c |= c_mask;
-  position->total_d |= d_mask;
   position->piece_square[(int)index] = square;
   position->piece_at[square] = piece;
   position->index_at[square] = index;
   position->hash ^= placement_key[piece][square];
+  if (piece_type[piece] == PAWN)
+    position->pawn_hash ^= placement_key[piece][square];
+  position->piece_count[piece]++;
+  position->material_phase += phase_weights[piece_type[piece]];
+  position->piece_square_score[TAPER_MG] +=
+      piece_square[piece][square][TAPER_MG];
+  position->piece_square_score[TAPER_EG] +=
+      piece_square[piece][square][TAPER_EG];
 }
 
 /* Alter `position` to remove a piece at `square`. */
@@ -116,25 +108,21 @@ static inline void remove_piece(struct position *position, enum square square) {
   int8_t piece = position->piece_at[square];
   enum piece player = piece_player[piece];
   bitboard_t a_mask = square2bit[square];
-  bitboard_t b_mask = square2bit[square_a2b[square]];
-  bitboard_t c_mask = square2bit[square_a2c[square]];
-  bitboard_t d_mask = square2bit[square_a2d[square]];
   position->a[piece] &= ~a_mask;
-  position->b[piece] &= ~b_mask;
-  position->c[piece] &= ~c_mask;
-  position->d[piece] &= ~d_mask;
   position->player_a[player] &= ~a_mask;
-  position->player_b[player] &= ~b_mask;
-  position->player_c[player] &= ~c_mask;
-  position->player_d[player] &= ~d_mask;
   position->total_a &= ~a_mask;
-  position->total_b &= ~b_mask;
-  position->total_c &= ~c_mask;
-  position->total_d &= ~d_mask;
   position->piece_square[(int)position->index_at[square]] = NO_SQUARE;
   position->piece_at[square] = EMPTY;
   position->index_at[square] = EMPTY;
   position->hash ^= placement_key[piece][square];
+  if (piece_type[piece] == PAWN)
+    position->pawn_hash ^= placement_key[piece][square];
+  position->piece_count[piece]--;
+  position->material_phase -= phase_weights[piece_type[piece]];
+  position->piece_square_score[TAPER_MG] -=
+      piece_square[piece][square][TAPER_MG];
+  position->piece_square_score[TAPER_EG] -=
+      piece_square[piece][square][TAPER_EG];
 }
 
 /* Clear the castling rights in `position` for the rook at `square` owned by
@@ -173,12 +161,29 @@ static inline void do_rook_castling_move(struct position *position,
 }
 
 /* Alter the position to make a move, without validity checking. Update `move`
-   with the result */
-void make_move(struct position *position, struct move *move) {
+   with the result.  Record the information needed to unmake the move in
+   `undo`. */
+void make_move_save(struct position *position, struct move *move,
+                    struct undo *undo) {
   ASSERT(is_valid_square(move->from));
   ASSERT(is_valid_square(move->to));
   ASSERT(move->from != move->to);
 
+  undo->from = move->from;
+  undo->to = move->to;
+  undo->moving_piece = position->piece_at[move->from];
+  undo->captured_piece = EMPTY;
+  undo->castling_rights = position->castling_rights;
+  undo->turn = position->turn;
+  undo->check[WHITE] = position->check[WHITE];
+  undo->check[BLACK] = position->check[BLACK];
+  undo->check_known = position->check_known;
+  undo->halfmove = position->halfmove;
+  undo->en_passant = position->en_passant;
+  undo->hash = position->hash;
+  undo->id = position->id;
+  undo->phase = position->phase;
+
   move->result = 0;
 
   position->halfmove++;
@@ -192,6 +197,9 @@ void make_move(struct position *position, struct move *move) {
     ASSERT(piece_type[victim_piece] != KING);
     enum player victim_player = piece_player[victim_piece];
     ASSERT(victim_player != position->turn);
+    undo->captured_piece = victim_piece;
+    undo->captured_index = position->index_at[move->to];
+    undo->captured_square = move->to;
     remove_piece(position, move->to);
     move->result |= CAPTURED;
     if (piece_type[victim_piece] == ROOK) {
@@ -251,6 +259,9 @@ void make_move(struct position *position, struct move *move) {
         ASSERT(position->piece_at[target_square] != EMPTY);
         ASSERT(piece_player[position->piece_at[target_square]] !=
                position->turn);
+        undo->captured_piece = position->piece_at[target_square];
+        undo->captured_index = position->index_at[target_square];
+        undo->captured_square = target_square;
         remove_piece(position, target_square);
         move->result |= EN_PASSANT | CAPTURED;
       }
@@ -272,18 +283,10 @@ void make_move(struct position *position, struct move *move) {
     }
   }
 
-  /* Pre-calculate moves for all pieces */
-  calculate_moves(position);
-
-  /* Test for check on both sides */
-  for (enum player player = 0; player < N_PLAYERS; player++) {
-    int king_square = bit2square(position->a[KING + player * N_PIECE_T]);
-    if (get_attacks(position, king_square, opponent[player])) {
-      position->check[player] = 1;
-    } else {
-      position->check[player] = 0;
-    }
-  }
+  /* The new position gets a new `id`, so its moves are calculated when they
+   * are first needed.  Check is also calculated when first needed. */
+  position->id = ++position->next_id;
+  position->check_known = 0;
 
   position->ply++;
   if (position->turn == BLACK) position->fullmove++;
@@ -295,6 +298,60 @@ void make_move(struct position *position, struct move *move) {
   }
 }
 
+/* Alter the position to make a move, without validity checking. Update `move`
+   with the result */
+void make_move(struct position *position, struct move *move) {
+  struct undo undo;
+  make_move_save(position, move, &undo);
+}
+
+/* Restore `position` to the state it was in before the move recorded in `undo`
+ * was made, including the player turn. */
+void unmake_move(struct position *position, const struct undo *undo) {
+  /* Move the piece back, undoing any promotion */
+  int8_t moving_index = position->index_at[undo->to];
+  remove_piece(position, undo->to);
+  add_piece(position, undo->from, undo->moving_piece, moving_index);
+
+  /* Move the rook back from a castling move */
+  if (piece_type[(int)undo->moving_piece] == KING) {
+    if (undo->from == undo->to + 2) {
+      do_rook_castling_move(position, undo->to + 1, undo->to - 2);
+    } else if (undo->from == undo->to - 2) {
+      do_rook_castling_move(position, undo->to - 1, undo->to + 1);
+    }
+  }
+
+  /* Replace any captured piece */
+  if (undo->captured_piece != EMPTY) {
+    add_piece(position, undo->captured_square, undo->captured_piece,
+              undo->captured_index);
+  }
+
+  /* Restore state.  `fullmove` is incremented after black moves. */
+  position->turn = undo->turn;
+  position->castling_rights = undo->castling_rights;
+  position->check[WHITE] = undo->check[WHITE];
+  position->check[BLACK] = undo->check[BLACK];
+  position->check_known = undo->check_known;
+  position->halfmove = undo->halfmove;
+  position->en_passant = undo->en_passant;
+  position->hash = undo->hash;
+  position->id = undo->id;
+  position->phase = undo->phase;
+  position->ply--;
+  if (position->turn == BLACK) position->fullmove--;
+}
+
+/* Calculate whether `player` is in check in `position`, called by
+ * `player_in_check` the first time it is needed. */
+void calculate_check(struct position *position, enum player player) {
+  enum square king_square = bit2square(position->a[KING + player * N_PIECE_T]);
+  position->check[player] =
+      (get_attacks(position, king_square, opponent[player]) != 0);
+  position->check_known |= 1 << player;
+}
+
 /* Alter `position` to change the player turn.  Called by functions in
  * `search.c` and `ui.c` after making a move. */
 void change_player(struct position *position) {
@@ -309,8 +366,16 @@ int check_legality(const struct position *position, const struct move *move) {
   if (move->from == move->to) return ERR_SRC_EQUAL_DEST;
   if ((square2bit[move->from] & get_my_pieces(position)) == 0)
     return ERR_NOT_MY_PIECE;
-  if ((square2bit[move->to] & get_moves(position, move->from)) == 0)
-    return ERR_CANT_MOVE_THERE;
+  struct legality legality;
+  get_legality(position, &legality);
+  if ((square2bit[move->to] &
+       get_legal_moves(position, &legality, move->from)) == 0) {
+    /* Distinguish moves which the piece could make if it didn't leave the
+     * king in check */
+    return (square2bit[move->to] & get_piece_moves(position, move->from))
+               ? ERR_SELF_CHECK
+               : ERR_CANT_MOVE_THERE;
+  }
   if ((is_promotion_move(position, move->from, move->to) &&
        (position->piece_at[move->from] == PAWN ||
         position->piece_at[move->from] == PAWN + N_PIECE_T)) ^
@@ -346,8 +411,8 @@ void setup_board(struct position *position, const enum piece *pieces,
       index++;
     }
   }
-  /* Generate moves */
-  calculate_moves(position);
+  /* Moves are generated when they are first needed */
+  position->id = position->next_id = 1;
 }
 
 /* Reset `position` to the starting position */
@@ -362,8 +427,6 @@ void init_board(void) {
   square2bit[NO_SQUARE] = 0;
   for (enum square square = 0; square < N_SQUARES; square++) {
     square2bit[square] = 1ull << square;
-    square_a2b[square] = (square / 8) + (square % 8) * 8;
-    square_a2d[square] = square_a2c[(square / 8) * 8 + (7 - square % 8)];
   }
   init_moves();
 }
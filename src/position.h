@@ -82,9 +82,8 @@ typedef unsigned long long bitboard_t;
  * The position of the game
  */
 
-/* Four stacks are used to represent the same information with different bit
-   orders, with the squares indexed according to horizontal, vertical and
-   diagonal schemes. */
+/* The stack of bitboards is indexed by piece, with the squares numbered
+   horizontally from A1. */
 
 enum {
   /* Total number of bitboards in a stack - there is one bitboard for each type
@@ -98,38 +97,50 @@ enum phase {
   ENDGAME,
 };
 
-/* Position, game state, and pre-calculated moves
- * 928 bytes */
+/* Total of `phase_weights` for the pieces in the starting position */
+enum { MAX_MATERIAL_PHASE = 24 };
+
+/* Middlegame and endgame parts of a tapered evaluation score */
+enum taper { TAPER_MG, TAPER_EG, N_TAPER };
+
+/* Position, game state, and pre-calculated moves.  The fields are grouped into
+ * 64-byte cache lines, which are checked in position.c: the bitboards, the keys
+ * and state updated by every move, the piece lists, the board, and last, the
+ * cache of moves, which making a move does not touch.  Squares and piece
+ * indices are stored in single bytes.  664 bytes. */
 struct position {
-  /* The stacks */
-  bitboard_t a[N_PLANES];         /* 8*12 -  Horizontal    */
-  bitboard_t b[N_PLANES];         /* 8*12 |  Vertical      */
-  bitboard_t c[N_PLANES];         /* 8*12 /  Diagonal      */
-  bitboard_t d[N_PLANES];         /* 8*12 \  Diagonal      */
+  /* Lines 0-1 - the stack */
+  bitboard_t a[N_PLANES];         /* 8*12 Set of each type of piece */
   bitboard_t player_a[N_PLAYERS]; /* 8*2  Set of each players pieces */
-  bitboard_t player_b[N_PLAYERS]; /* 8*2  Set of each players pieces */
-  bitboard_t player_c[N_PLAYERS]; /* 8*2  Set of each players pieces */
-  bitboard_t player_d[N_PLAYERS]; /* 8*2  Set of each players pieces */
   bitboard_t total_a;             /* 8    Set of all pieces */
-  bitboard_t total_b;             /* 8    Set of all pieces */
-  bitboard_t total_c;             /* 8    Set of all pieces */
-  bitboard_t total_d;             /* 8    Set of all pieces */
-  bitboard_t moves[N_PIECES]; /* 8*32 Set of squares each piece can move to */
-  bitboard_t
-      claim[N_PLAYERS]; /* 8*2 Set of all squares each player can move to */
-  enum square
-      piece_square[N_PIECES];      /* 4(?)*32 Square location of each piece */
-  int8_t piece_at[N_SQUARES];      /* 1*64 Type of piece at each square */
-  int8_t index_at[N_SQUARES];      /* 1*64 Piece index at each board position */
+  bitboard_t en_passant;          /* 8    En-passant squares */
+  /* Line 2 - keys and game state */
+  hash_t hash;                     /* 8 */
+  hash_t pawn_hash;                /* 8 Hash of the pawns only */
+  unsigned long long id;           /* 8 Identifies this position in the game */
+  unsigned long long next_id;      /* 8 Next unused `id` */
+  int piece_square_score[N_TAPER]; /* 4*2 Sum of `piece_square`, white's view */
+  int material_phase;              /* 4 Sum of `phase_weights` of the pieces */
   int halfmove;                    /* 4 */
   int fullmove;                    /* 4 */
-  status_t turn : 1;               /* 1 Player to move next */
+  int ply;                         /* 4 */
+  status_t turn;                   /* 1 Player to move next */
   status_t check[N_PLAYERS];       /* 1*2 Whether each player is in check */
+  status_t check_known;            /* 1 Bit set of players with `check` set */
   castle_rights_t castling_rights; /* 1 */
-  bitboard_t en_passant;           /* 8 En-passant squares */
-  hash_t hash;                     /* 8 */
-  int ply;                         /* 4 */
-  enum phase phase;
+  uint8_t phase;                   /* 1 `enum phase` */
+  uint8_t pad_state[2];            /* 2 Fills the line */
+  /* Line 3 - piece lists */
+  int8_t piece_square[N_PIECES]; /* 1*32 Square location of each piece */
+  uint8_t piece_count[N_PLANES]; /* 1*12 Number of each type of piece */
+  uint8_t pad_pieces[20];        /* 20 Fills the line */
+  /* Lines 4-5 - the board */
+  int8_t piece_at[N_SQUARES]; /* 1*64 Type of piece at each square */
+  int8_t index_at[N_SQUARES]; /* 1*64 Piece index at each board position */
+  /* Lines 6-10 - cached moves and claims */
+  bitboard_t moves[N_PIECES];  /* 8*32 Set of squares each piece can move to */
+  bitboard_t claim[N_PLAYERS]; /* 8*2 Set of squares each player can move to */
+  unsigned long long moves_id; /* 8 `id` when `moves` and `claim` were set */
 };
 
 /* Bit set for indicating result conditions */
@@ -144,7 +155,8 @@ enum {
   PROMOTED = 1 << 6,
 };
 
-/* A move */
+/* A move, with the moving piece and the result of making it.  This is the
+ * form that is made and formatted for output. */
 struct move {
   enum square from, to;
   enum piece piece;
@@ -152,6 +164,38 @@ struct move {
   moveresult_t result;
 };
 
+/* A move packed into 16 bits, the form in which moves are stored by the
+ * search: in move lists, the transposition table, the killer and countermove
+ * tables and the principal variation.  Castling and en-passant are recognised
+ * from the position when the move is made, so they need no flags. */
+typedef uint16_t move_t;
+enum {
+  MOVE_FROM_SHIFT = 0,       /* 6 bits */
+  MOVE_TO_SHIFT = 6,         /* 6 bits */
+  MOVE_PROMOTION_SHIFT = 12, /* 3 bits - PAWN if the move doesn't promote */
+  NO_MOVE = 0                /* From and to A1, which is never a move */
+};
+
+/* Information needed to unmake a move, recorded by `make_move_save`.  The
+ * pre-calculated moves and claims are not saved.  They are recalculated if they
+ * are needed again after being overwritten by a later position. */
+struct undo {
+  enum square from, to;
+  int8_t moving_piece;     /* Piece that moved, before any promotion */
+  int8_t captured_piece;   /* EMPTY if nothing was captured */
+  int8_t captured_index;   /* Piece index of the captured piece */
+  int8_t captured_square;  /* Differs from `to` for en-passant captures */
+  castle_rights_t castling_rights;
+  status_t turn;
+  status_t check[N_PLAYERS];
+  status_t check_known;
+  int halfmove;
+  bitboard_t en_passant;
+  hash_t hash;
+  unsigned long long id;
+  enum phase phase;
+};
+
 /* Invalid move conditions */
 enum {
   ERR_BASE = 0,       /* OK */
@@ -161,6 +205,7 @@ enum {
   ERR_CANT_MOVE_THERE, /* The piece at the "from" square can't legally move to
                           the "to" square */
   ERR_PROMOTION,       /* Illegal promotion to a pawn */
+  ERR_SELF_CHECK,      /* The move would leave the player's king in check */
   N_MOVE_ERR
 };
 
@@ -168,6 +213,7 @@ extern bitboard_t *square2bit;
 extern const enum piece piece_type[N_PLANES];
 extern const enum player piece_player[N_PLANES];
 extern const enum player opponent[N_PLAYERS];
+extern const int phase_weights[N_PIECE_T];
 
 void init_board(void);
 void reset_board(struct position *position);
@@ -176,10 +222,51 @@ void setup_board(struct position *, const enum piece *, enum player,
 
 bitboard_t get_attacks(const struct position *position, enum square target,
                        enum player attacking);
+void calculate_moves(struct position *position);
+void calculate_check(struct position *position, enum player player);
 void make_move(struct position *position, struct move *move);
+void make_move_save(struct position *position, struct move *move,
+                    struct undo *undo);
+void unmake_move(struct position *position, const struct undo *undo);
 void change_player(struct position *position);
 int check_legality(const struct position *position, const struct move *move);
 
+/* Pack a move into a `move_t` */
+static inline move_t pack_move(enum square from, enum square to,
+                               enum piece promotion) {
+  return (move_t)(from << MOVE_FROM_SHIFT | to << MOVE_TO_SHIFT |
+                  promotion << MOVE_PROMOTION_SHIFT);
+}
+static inline enum square move_from(move_t move) {
+  return (enum square)((move >> MOVE_FROM_SHIFT) & 0x3f);
+}
+static inline enum square move_to(move_t move) {
+  return (enum square)((move >> MOVE_TO_SHIFT) & 0x3f);
+}
+static inline enum piece move_promotion(move_t move) {
+  return (enum piece)((move >> MOVE_PROMOTION_SHIFT) & 0x7);
+}
+static inline move_t encode_move(const struct move *move) {
+  return pack_move(move->from, move->to, move->promotion);
+}
+/* Unpack a move to be made.  The moving piece is not known without the
+ * position, and the result is filled in by making the move. */
+static inline void decode_move(move_t packed, struct move *move) {
+  move->from = move_from(packed);
+  move->to = move_to(packed);
+  move->piece = EMPTY;
+  move->promotion = move_promotion(packed);
+  move->result = 0;
+}
+
+/* The move is not a capture or a promotion */
+static inline int is_quiet_move(const struct position *position, move_t move) {
+  enum square to = move_to(move);
+  return position->piece_at[to] == EMPTY &&
+         !(square2bit[to] & position->en_passant) &&
+         move_promotion(move) == PAWN;
+}
+
 /* Two moves are identical */
 static inline int move_equal(const struct move *move1,
                              const struct move *move2) {
@@ -205,11 +292,27 @@ static inline void copy_position(struct position *dst,
                                  const struct position *src) {
   memcpy(dst, src, sizeof(struct position));
 }
+/* The moves and claims are calculated lazily, the first time they are needed
+ * in a position.  They are a cache rather than part of the state of the
+ * position, so they can be filled in through a const pointer. */
+static inline int moves_calculated(const struct position *position) {
+  return position->moves_id == position->id;
+}
+static inline void ensure_moves(const struct position *position) {
+  if (!moves_calculated(position)) calculate_moves((struct position *)position);
+}
 /* Return the set of squares that the piece on the given square can move to */
 static inline bitboard_t get_moves(const struct position *position,
                                    enum square square) {
+  ensure_moves(position);
   return position->moves[(int)position->index_at[square]];
 }
+/* Return the set of all squares that `player` can move to */
+static inline bitboard_t get_claim(const struct position *position,
+                                   enum player player) {
+  ensure_moves(position);
+  return position->claim[player];
+}
 /* Return the set of squares containing the moving player's pieces */
 static inline bitboard_t get_my_pieces(const struct position *position) {
   return position->player_a[position->turn];
@@ -218,9 +321,16 @@ static inline bitboard_t get_my_pieces(const struct position *position) {
 static inline bitboard_t get_opponents_pieces(const struct position *position) {
   return position->player_a[!position->turn];
 }
+/* The player is in check.  This is calculated lazily like the moves. */
+static inline int player_in_check(const struct position *position,
+                                  enum player player) {
+  if (!(position->check_known & (1 << player)))
+    calculate_check((struct position *)position, player);
+  return position->check[player];
+}
 /* The player to move is in check */
 static inline int in_check(const struct position *position) {
-  return position->check[position->turn];
+  return player_in_check(position, position->turn);
 }
 /* The move goes to the back row, true even if not a pawn. */
 static inline int is_promotion_move(const struct position *position,
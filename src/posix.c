@@ -6,6 +6,7 @@
 #define _POSIX_C_SOURCE 200809L
 
 #include <execinfo.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -47,6 +48,88 @@ void setup_signal_handlers(void) {
 /* SIGINT is ignored for XBoard mode */
 void ignore_sigint(void) { signal(SIGINT, SIG_IGN); }
 
+/*
+ *    Threads
+ */
+
+enum { THREAD_STACK_SIZE = 16 * 1024 * 1024 };
+
+/* Thread handle with the function it runs */
+struct thread {
+  pthread_t handle;
+  thread_fn fn;
+  void *arg;
+};
+
+/* Entry point for a new thread - adapts `thread_fn` to pthreads */
+static void *thread_entry(void *arg) {
+  struct thread *thread = (struct thread *)arg;
+  thread->fn(thread->arg);
+  return 0;
+}
+
+/* Start a new thread running `fn(arg)`.  Return zero if the thread can't be
+ * created. */
+struct thread *thread_create(thread_fn fn, void *arg) {
+  struct thread *thread = (struct thread *)malloc(sizeof(*thread));
+  if (!thread) return 0;
+  thread->fn = fn;
+  thread->arg = arg;
+
+  /* Search recursion needs a deeper stack than some platforms give threads by
+   * default */
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, THREAD_STACK_SIZE);
+  int err = pthread_create(&thread->handle, &attr, thread_entry, thread);
+  pthread_attr_destroy(&attr);
+  if (err) {
+    free(thread);
+    return 0;
+  }
+  return thread;
+}
+
+/* Wait for a thread to finish and free its handle */
+void thread_join(struct thread *thread) {
+  pthread_join(thread->handle, 0);
+  free(thread);
+}
+
+/* Mutex and condition variable */
+struct lock {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+};
+
+/* Create a lock.  Return zero if it can't be created. */
+struct lock *lock_create(void) {
+  struct lock *lock = (struct lock *)malloc(sizeof(*lock));
+  if (!lock) return 0;
+  pthread_mutex_init(&lock->mutex, 0);
+  pthread_cond_init(&lock->cond, 0);
+  return lock;
+}
+
+/* Free a lock, which must not be held */
+void lock_destroy(struct lock *lock) {
+  pthread_cond_destroy(&lock->cond);
+  pthread_mutex_destroy(&lock->mutex);
+  free(lock);
+}
+
+void lock_acquire(struct lock *lock) { pthread_mutex_lock(&lock->mutex); }
+
+void lock_release(struct lock *lock) { pthread_mutex_unlock(&lock->mutex); }
+
+/* Release a held lock, wait until notified, then hold it again */
+void lock_wait(struct lock *lock) {
+  pthread_cond_wait(&lock->cond, &lock->mutex);
+}
+
+/* Wake all threads waiting on a lock */
+void lock_notify(struct lock *lock) { pthread_cond_broadcast(&lock->cond); }
+
 /*
  *    Terminal
  */
@@ -7,6 +7,7 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include "evaluate.h"
@@ -26,117 +27,401 @@
 #define OPT_KILLER 1
 #define OPT_HASH 1
 #define OPT_STAND_PAT 1
-/* OPT_LMR + OPT_NULL = +20 elo over 10 games */
-#define OPT_LMR 0
 #define OPT_PAWN_EXTENSION 0 /* This is probably a bad idea */
-#define OPT_NULL 0
+
+/* Detailed statistics are counted with STAT(), which compiles to nothing
+   unless SEARCH_STATS is defined */
+#ifdef SEARCH_STATS
+#  define STAT(x) (x)
+#else
+#  define STAT(x)
+#endif
 
 enum {
   TT_MIN_DEPTH = 4,
   QUIESCENCE_MAX_DEPTH = 50,
   MIN_ITERATION_DEPTH = 1,
   MAX_ITERATION_DEPTH = 20,
+  /* Deepest fixed-depth search, leaving plies below SEARCH_DEPTH_MAX for
+     extensions and quiescence */
+  MAX_TARGET_DEPTH = SEARCH_DEPTH_MAX / 2,
   INFINITY_SCORE = 10000,
   INVALID_SCORE = 10100,
   CHECKMATE_SCORE = -INFINITY_SCORE,
   DRAW_SCORE = 0,
   CONTEMPT_SCORE = -500,
-  R_NULL = 2, /* Depth reduction for null move search */
-  R_LATE = 1, /* Depth reduction for late move reduction */
   NODES_PER_CHECK = 2000,
+  ASPIRATION_DEFAULT = 100, /* Half-width of the root window, 0 to disable */
+  FUTILITY_MAX_DEPTH = 3,   /* Deepest remaining depth for futility pruning */
+  RAZORING_MAX_DEPTH = 2,   /* Deepest remaining depth for razoring */
+  LMR_TABLE_SIZE = 64,      /* Depths and move counts in the LMR table */
+  N_QUIETS_TRIED = 64,      /* Quiet moves penalised after a quiet cutoff */
 };
 
 struct move mate_move = {.result = CHECK | MATE};
 
+/*
+ *  User options
+ */
+
+/* Number of threads for Lazy SMP search, including the main thread */
+int search_threads = 1;
+
+/* Principal variation search, and the aspiration window at the root */
+int pvs_enabled = 1;
+int aspiration_window = ASPIRATION_DEFAULT;
+
+/* Set from another thread to stop the search, which then returns the result
+   of the last complete iteration */
+volatile int search_interrupt = 0;
+
+/* A search started while this is set has no time limit.  Clearing it from
+   another thread (a ponder hit) starts the search's time budget from then */
+volatile int search_pondering = 0;
+
+/* Thoughts are shown at most once per `search_thought_interval` seconds, the
+   latest one being shown when the interval is over.  Setting
+   `search_status_request` from another thread shows the progress of the
+   current iteration. */
+double search_thought_interval = 0.0;
+volatile int search_status_request = 0;
+
+/* Nodes after which the search stops once it has a result, or 0 */
+long long search_node_limit = 0;
+
+/* Number of best lines found by each search */
+int search_multi_pv = 1;
+
+/* Root moves which the next search must not play, and their number */
+move_t search_excluded[MULTI_PV_MAX];
+int search_n_excluded = 0;
+
+/* Function used to show thoughts, for the protocol in use */
+thought_fn search_thought = xboard_thought;
+
+/* Null move pruning - depth reduction, and the depth from which a cutoff is
+ * verified by a reduced search without the null move */
+int null_move_enabled = 1;
+int null_move_reduction = 2;
+int null_move_verify_depth = 6;
+
+/* Late move reductions - quiet moves after the first `lmr_min_moves` at depths
+ * from `lmr_min_depth` are reduced by ln(depth) * ln(moves) / (divisor / 100)
+ */
+int lmr_enabled = 1;
+int lmr_min_depth = 3;
+int lmr_min_moves = 3;
+int lmr_divisor = 225;
+
+/* Futility pruning and razoring - margins per ply of remaining depth */
+int futility_enabled = 1;
+int futility_margin = 150;
+int razoring_enabled = 1;
+int razoring_margin = 300;
+
+/* Search user options. */
+const struct option _search_opts[] = {
+    /* clang-format off */
+  { "Threads",               SPIN_OPT, .value.integer = &search_threads,  1, MAX_THREADS, 0 },
+  { "PVS",                   BOOL_OPT, .value.integer = &pvs_enabled,     0, 0, 0 },
+  { "Aspiration window",     SPIN_OPT, .value.integer = &aspiration_window, 0, INFINITY_SCORE, 0 },
+  { "MultiPV",               SPIN_OPT, .value.integer = &search_multi_pv, 1, MULTI_PV_MAX, 0 },
+  { "Null move",             BOOL_OPT, .value.integer = &null_move_enabled, 0, 0, 0 },
+  { "Null move reduction",   SPIN_OPT, .value.integer = &null_move_reduction, 1, 4, 0 },
+  { "Null move verification depth", SPIN_OPT, .value.integer = &null_move_verify_depth, 1, SEARCH_DEPTH_MAX, 0 },
+  { "LMR",                   BOOL_OPT, .value.integer = &lmr_enabled,     0, 0, 0 },
+  { "LMR min depth",         SPIN_OPT, .value.integer = &lmr_min_depth,   2, LMR_TABLE_SIZE, 0 },
+  { "LMR min moves",         SPIN_OPT, .value.integer = &lmr_min_moves,   1, LMR_TABLE_SIZE, 0 },
+  { "LMR divisor %",         SPIN_OPT, .value.integer = &lmr_divisor,     50, 1000, 0 },
+  { "Futility",              BOOL_OPT, .value.integer = &futility_enabled, 0, 0, 0 },
+  { "Futility margin",       SPIN_OPT, .value.integer = &futility_margin, 0, INFINITY_SCORE, 0 },
+  { "Razoring",              BOOL_OPT, .value.integer = &razoring_enabled, 0, 0, 0 },
+  { "Razoring margin",       SPIN_OPT, .value.integer = &razoring_margin, 0, INFINITY_SCORE, 0 },
+    /* clang-format on */
+};
+const struct options search_opts = {
+    sizeof(_search_opts) / sizeof(_search_opts[0]), _search_opts};
+
 static score_t search_position(struct search_job *job, struct pv *parent_pv,
                                struct position *position, int depth,
                                score_t alpha, score_t beta, int do_nullmove);
+static int count_all_nodes(const struct search_job *job);
+
+/* Late move reductions for each remaining depth and number of moves already
+ * searched, built from the options by `build_lmr_table` */
+int lmr_reductions[LMR_TABLE_SIZE][LMR_TABLE_SIZE];
+int lmr_built_divisor = -1;
+
+/* Build `lmr_reductions` if the divisor option has changed */
+static void build_lmr_table(void) {
+  if (lmr_built_divisor == lmr_divisor) return;
+  for (int depth = 1; depth < LMR_TABLE_SIZE; depth++) {
+    for (int moves = 1; moves < LMR_TABLE_SIZE; moves++) {
+      lmr_reductions[depth][moves] =
+          (int)(log((double)depth) * log((double)moves) * 100.0 /
+                (double)lmr_divisor);
+    }
+  }
+  lmr_built_divisor = lmr_divisor;
+}
+
+/* Return the reduction for a late move at `depth` after `n_moves` legal moves,
+ * before checking whether the move itself may be reduced */
+static inline int get_lmr_reduction(int depth, int n_moves, int pv_node) {
+  if (!lmr_enabled || depth < lmr_min_depth || n_moves < lmr_min_moves)
+    return 0;
+  if (depth >= LMR_TABLE_SIZE) depth = LMR_TABLE_SIZE - 1;
+  if (n_moves >= LMR_TABLE_SIZE) n_moves = LMR_TABLE_SIZE - 1;
+  int reduction = lmr_reductions[depth][n_moves] - pv_node;
+  /* Always leave at least one ply before quiescence */
+  if (reduction > depth - 2) reduction = depth - 2;
+  return (reduction > 0) ? reduction : 0;
+}
+
+/* Return whether `player` has any pieces other than pawns and the king.  Null
+   move pruning is unsafe without them, because zugzwang is likely. */
+static inline int has_non_pawn_material(const struct position *position,
+                                        enum player player) {
+  const uint8_t *count = &position->piece_count[player * N_PIECE_T];
+  return count[ROOK] || count[KNIGHT] || count[BISHOP] || count[QUEEN];
+}
 
 /* Null-move reduction search - evaluate at depth the consequences of
-   hypothetically passing on a turn without making a move. */
+   hypothetically passing on a turn without making a move.  If the opponent
+   still can't reach beta, the position is good enough to cut off.  At greater
+   depths the cutoff is verified by a reduced search without a null move. */
 static inline int search_null(struct search_job *job, struct pv *pv,
-                              struct position *from_position, int depth,
-                              score_t alpha, score_t beta) {
-  /* Can't nullmove if already in check */
-  if (in_check(from_position)) return 0;
+                              struct position *position, int depth,
+                              score_t beta) {
+  struct prune_stats *stats = &job->result.prune[PRUNE_NULL_MOVE];
+  int reduction = null_move_reduction + depth / 6;
+  stats->attempts++;
+
+  /* Pass the turn.  An en-passant capture is no longer possible, so the moves
+     calculated for this position don't apply. */
+  bitboard_t en_passant = position->en_passant;
+  unsigned long long id = position->id;
+  if (en_passant) {
+    position->en_passant = 0;
+    position->id = ++position->next_id;
+  }
+  job->search_history[position->ply - job->root_ply] = NO_MOVE;
+  stack_push_null(job->stack);
+  position->ply++;
+  change_player(position);
 
-  struct position position;
-  copy_position(&position, from_position);
+  /* Recurse into search_position.  `do_nullmove` = 0 so the next ply can't also
+     test a null move. */
+  score_t score = -search_position(job, pv, position, depth - reduction - 1,
+                                   -beta, -beta + 1, 0);
+
+  change_player(position);
+  position->ply--;
+  stack_pop(job->stack);
+  position->en_passant = en_passant;
+  position->id = id;
+
+  if (score < beta || job->halt) return 0;
+
+  /* Verification */
+  if (depth >= null_move_verify_depth) {
+    stats->researches++;
+    score = search_position(job, pv, position, depth - reduction, beta - 1,
+                            beta, 0);
+    if (score < beta || job->halt) return 0;
+  }
 
-  /* The move would be made here */
+  stats->cutoffs++;
+  return 1;
+}
 
-  change_player(&position);
+/* Count whether the position reached by a move needed its moves calculating
+   before it was unmade */
+static inline void count_moves_generated(struct search_job *job,
+                                         const struct position *position) {
+  if (moves_calculated(position))
+    job->result.n_moves_generated++;
+  else
+    job->result.n_moves_avoided++;
+}
 
-  /* Recurse into search_position.  `do_nullmove` = 0 so the next ply can't also
-     test a null move. */
-  score_t score =
-      -search_position(job, pv, &position, depth - R_NULL, -beta, -beta + 1, 0);
+#ifdef SEARCH_STATS
+/* Count a node for the detailed statistics */
+static inline void count_node(struct search_job *job,
+                              const struct position *position, int depth) {
+  int ply = position->ply - job->root_ply;
+  if (ply >= SEARCH_DEPTH_MAX) ply = SEARCH_DEPTH_MAX - 1;
+  job->result.stats.ply_nodes[ply]++;
+  if (depth <= 0) job->result.stats.quiescence_nodes++;
+}
 
-  /* Beta cutoff */
-  return (score >= beta);
+/* Count a beta cutoff by the `n_legal_moves`th move for the detailed
+   statistics */
+static inline void count_cutoff(struct search_job *job, int n_legal_moves,
+                                int quiescence) {
+  int index = n_legal_moves - 1;
+  if (index >= N_CUTOFF_INDEX) index = N_CUTOFF_INDEX - 1;
+  job->result.stats.cutoff_index[index]++;
+  if (!quiescence) job->result.stats.cut_nodes++;
+}
+
+/* Count a node which searched its moves without a beta cutoff, by the type of
+   its result, for the detailed statistics */
+static inline void count_node_type(struct search_job *job,
+                                   enum tt_entry_type type, int quiescence) {
+  if (quiescence) return;
+  if (type == TT_EXACT)
+    job->result.stats.pv_nodes++;
+  else
+    job->result.stats.all_nodes++;
+}
+
+/* Add the detailed statistics of a helper thread to `total` */
+static void add_stats(struct search_stats *total,
+                      const struct search_stats *stats) {
+  total->pv_nodes += stats->pv_nodes;
+  total->cut_nodes += stats->cut_nodes;
+  total->all_nodes += stats->all_nodes;
+  total->quiescence_nodes += stats->quiescence_nodes;
+  total->tt_cutoffs += stats->tt_cutoffs;
+  for (int i = 0; i < N_CUTOFF_INDEX; i++)
+    total->cutoff_index[i] += stats->cutoff_index[i];
+  for (int i = 0; i < SEARCH_DEPTH_MAX; i++)
+    total->ply_nodes[i] += stats->ply_nodes[i];
+}
+#endif
+
+/* Show the latest thought if one is waiting and the thought interval is over,
+   or if `force` is set */
+static void show_thought(struct search_job *job, int force) {
+  if (!job->thought_pending) return;
+  double now = time_now();
+  if (!force && now < job->next_thought_time) return;
+  job->next_thought_time = now + search_thought_interval;
+  job->thought_pending = 0;
+  double elapsed_time = now - job->start_time;
+  int n_node = count_all_nodes(job);
+  search_thought(job, job->thought_pv, job->thought_depth, job->thought_score,
+                 elapsed_time, n_node, (double)n_node / 1000.0 / elapsed_time,
+                 job->result.seldep);
+}
+
+/* Show the progress of the current iteration */
+static void show_status(struct search_job *job) {
+  int n_root_moves = job->n_root_moves;
+  if (n_root_moves < job->root_move_number)
+    n_root_moves = job->root_move_number;
+  xboard_status(time_now() - job->start_time, count_all_nodes(job), job->depth,
+                n_root_moves - job->root_move_number, n_root_moves,
+                &job->root_position, job->root_move);
 }
 
-/* Search a single move - call search_position after making the move. Return 1
-   for a beta cutoff, and 0 in all other cases including self-check. */
+/* Return whether `move` is excluded at the root, having been found as one of
+   the best lines already */
+static inline int is_excluded(const struct search_job *job, move_t move) {
+  for (int i = 0; i < job->n_excluded; i++)
+    if (move == job->excluded[i]) return 1;
+  return 0;
+}
+
+/* Search a single move - make the move in place, call search_position, then
+   unmake the move. Return 1 for a beta cutoff, and 0 in all other cases
+   including self-check.  If the move is quiet, reduce its depth by
+   `reduction`, or skip it if `futile`. */
 static inline int search_move(struct search_job *job, struct pv *parent_pv,
-                              struct pv *pv,
-                              const struct position *from_position, int depth,
-                              score_t *best_score, /* in/out */
-                              score_t *alpha,      /* in/out */
-                              score_t beta, struct move *move,
-                              struct move **best_move,  /* in/out */
+                              struct pv *pv, struct position *position,
+                              int depth, score_t *best_score, /* in/out */
+                              score_t *alpha,                 /* in/out */
+                              score_t beta, move_t move,
+                              move_t *best_move,        /* in/out */
                               enum tt_entry_type *type, /* in/out */
                               int *n_legal_moves,       /* in/out */
-                              int is_late_move) {
-  struct position position;
+                              int reduction, int futile) {
+  if (depth == job->depth && is_excluded(job, move)) return 0;
+
+  /* Information about the position being moved from, needed after the move is
+   * made */
+  hash_t hash = position->hash;
+  int was_in_check = in_check(position);
+  struct move made;
+  decode_move(move, &made);
+  int is_pawn_move = (position->piece_at[made.from] == PAWN);
+
+  /* The move picker only gives legal moves */
+  struct undo undo;
+  make_move_save(position, &made, &undo);
+  ASSERT(!in_check(position));
+  if (n_legal_moves) (*n_legal_moves)++;
+  if (depth == job->depth) {
+    job->root_move = move;
+    job->root_move_number = *n_legal_moves;
+  }
 
-  /* Copy and move */
-  copy_position(&position, from_position);
-  make_move(&position, move);
+  /* Quiet moves are the ones which may be pruned or reduced */
+  int gives_check = player_in_check(position, opponent[position->turn]);
+  int is_quiet = !was_in_check && !gives_check &&
+                 undo.captured_piece == EMPTY && made.promotion == PAWN;
 
-  /* Return early if moving into self-check. All other moves are legal. */
-  if (in_check(&position)) {
-    job->result.n_check_moves++;
+  /* Futility pruning */
+  if (futile && is_quiet) {
+    job->result.prune[PRUNE_FUTILITY].cutoffs++;
+    count_moves_generated(job, position);
+    unmake_move(position, &undo);
     return 0;
   }
-  //  ASSERT(!in_check(&position));
-  if (n_legal_moves) (*n_legal_moves)++;
 
   score_t score;
   /* Move history is hashed against the position being moved from */
-  history_push(job->history, from_position->hash, move);
-  change_player(&position);
-
-  /* Record whether this move puts the opponent in check */
-  if (in_check(&position)) move->result |= CHECK;
+  job->search_history[position->ply - 1 - job->root_ply] = move;
+  stack_push(job->stack, hash);
+  change_player(position);
 
   /* Late move reduction and extensions
      Reduce the search depth for late moves unless they are tactical. Extend
      the depth for pawn moves to try to find a promotion. */
   int extend_reduce;
-  if (OPT_PAWN_EXTENSION && from_position->piece_at[move->from] == PAWN &&
-      depth < job->depth - 1)
+  if (OPT_PAWN_EXTENSION && is_pawn_move && depth < job->depth - 1)
     extend_reduce = 1;
-  else if (OPT_LMR && is_late_move && !in_check(from_position) &&
-           !in_check(&position) && from_position->piece_at[move->to] == EMPTY &&
-           move->promotion == PAWN)
-    extend_reduce = -R_LATE;
+  else if (reduction && is_quiet)
+    extend_reduce = -reduction;
   else
     extend_reduce = 0;
+  if (extend_reduce < 0) job->result.prune[PRUNE_LMR].attempts++;
+
+  /* Principal variation search - after the first move, assume that the moves
+     are ordered well enough that the rest will not improve on alpha, and
+     prove it with a null window search, which is cheaper.  If the assumption
+     fails, re-search with the full window. */
+  int null_window = pvs_enabled && n_legal_moves && *n_legal_moves > 1 &&
+                    beta - *alpha > 1;
+  score_t child_alpha = null_window ? -*alpha - 1 : -beta;
 
   /* Recurse into search_position */
-  score = -search_position(job, pv, &position, depth + extend_reduce - 1, -beta,
-                           -*alpha, 1);
+  score = -search_position(job, pv, position, depth + extend_reduce - 1,
+                           child_alpha, -*alpha, 1);
 
   /* If a reduced search produces a score which will cause an update,
      re-search at full depth in case it turns out to be not so good */
-  if (extend_reduce < 0 && score > *alpha) {
-    score = -search_position(job, pv, &position, depth - 1, -beta, -*alpha, 1);
+  if (extend_reduce < 0) {
+    if (score > *alpha) {
+      job->result.prune[PRUNE_LMR].researches++;
+      score = -search_position(job, pv, position, depth - 1, child_alpha,
+                               -*alpha, 1);
+    } else {
+      job->result.prune[PRUNE_LMR].cutoffs++;
+    }
   }
 
-  if (job->halt) return 1;
+  if (null_window && score > *alpha && score < beta && !job->halt) {
+    job->result.n_pvs_researches++;
+    score = -search_position(job, pv, position, depth - 1, -beta, -*alpha, 1);
+  }
 
-  history_pop(job->history);
+  count_moves_generated(job, position);
+  unmake_move(position, &undo);
+  stack_pop(job->stack);
+
+  if (job->halt) return 1;
 
   if (score > *best_score) {
     *best_score = score;
@@ -150,21 +435,19 @@ static inline int search_move(struct search_job *job, struct pv *parent_pv,
 
     /* Update the PV and show it if it updates at root level */
     pv_add(parent_pv, pv, move);
-    double elapsed_time = time_now() - job->start_time;
-    if (job->show_thoughts && depth == job->depth)
-      xboard_thought(job, parent_pv, depth, score, elapsed_time,
-                     job->result.n_leaf,
-                     (double)job->result.n_leaf / 1000.0 * elapsed_time,
-                     job->result.seldep);
+    if (job->show_thoughts && depth == job->depth && job->multi_pv <= 1) {
+      memcpy(job->thought_pv, parent_pv, sizeof(*job->thought_pv));
+      job->thought_score = score;
+      job->thought_depth = depth;
+      job->thought_pending = 1;
+      show_thought(job, 0);
+    }
   }
 
-  DEBUG_THOUGHT(job, pv, move, depth, score, *alpha, beta, position.hash);
+  DEBUG_THOUGHT(job, pv, move, depth, score, *alpha, beta, position->hash);
 
   /* Beta cutoff */
   if (score >= beta) {
-    if (depth >= 0) {
-      memcpy(&job->killer_moves[depth], move, sizeof(job->killer_moves[0]));
-    }
     *type = TT_BETA;
     return 1;
   }
@@ -174,15 +457,29 @@ static inline int search_move(struct search_job *job, struct pv *parent_pv,
 
 /* Update the result if at the top level */
 static inline void update_result(struct search_job *job, int depth,
-                                 struct move *move, score_t score) {
+                                 move_t move, score_t score) {
   if (depth == job->depth) {
     job->result.score = score;
-    if (move) {
-      memcpy(&job->result.move, move, sizeof(job->result.move));
-    }
+    if (move != NO_MOVE) job->best_move = move;
   }
 }
 
+/* Mate scores count the distance from the root to the mate, but an entry in
+ * the transposition table may be probed at another distance from the root, or
+ * in a later search.  They are stored counting the distance from the node
+ * instead, and converted back when they are probed. */
+static inline score_t score_to_tt(score_t score, int ply) {
+  if (score <= CHECKMATE_SCORE + SEARCH_DEPTH_MAX) return score - ply;
+  if (score >= -CHECKMATE_SCORE - SEARCH_DEPTH_MAX) return score + ply;
+  return score;
+}
+
+static inline score_t score_from_tt(score_t score, int ply) {
+  if (score <= CHECKMATE_SCORE + SEARCH_DEPTH_MAX) return score + ply;
+  if (score >= -CHECKMATE_SCORE - SEARCH_DEPTH_MAX) return score - ply;
+  return score;
+}
+
 /* Draw score is calclated on a basic contempt assumption, having no real
  * contempt factor for the opponent.  Early and midgame places a penalty of
  * CONTEMPT_SCORE on seeking a draw, otherwise DRAW_SCORE (zero) */
@@ -190,25 +487,86 @@ static score_t get_draw_score(const struct position *position) {
   return (OPT_CONTEMPT && !is_endgame(position)) ? CONTEMPT_SCORE : DRAW_SCORE;
 }
 
+/* Adjust a history heuristic score by `bonus`.  The adjustment shrinks as the
+   score approaches `HISTORY_MAX`, so scores stay in range and old results
+   gradually give way to new ones. */
+static inline void update_butterfly(int *score, int bonus) {
+  *score += bonus - *score * abs(bonus) / HISTORY_MAX;
+}
+
+/* Record that the quiet move `move` caused a beta cutoff at `ply`, after the
+   quiet moves in `tried` failed to.  `previous` is the move which led to this
+   position, or null. */
+static void update_quiet_ordering(struct search_job *job,
+                                  const struct position *position, int ply,
+                                  int depth, move_t move, const move_t *tried,
+                                  int n_tried, move_t previous) {
+  move_t *killers = job->killer_moves[ply];
+  if (move != killers[0]) {
+    killers[1] = killers[0];
+    killers[0] = move;
+  }
+  if (previous != NO_MOVE) {
+    enum square to = move_to(previous);
+    job->countermoves[(int)position->piece_at[to]][to] = move;
+  }
+  int(*butterfly)[N_SQUARES] = job->butterfly[position->turn];
+  int bonus = (depth < 20) ? depth * depth : 400;
+  update_butterfly(&butterfly[move_from(move)][move_to(move)], bonus);
+  for (int i = 0; i < n_tried; i++)
+    update_butterfly(&butterfly[move_from(tried[i])][move_to(tried[i])],
+                     -bonus);
+}
+
 /* Search a single position and all possible moves - call search_move for each
    move */
 static score_t search_position(struct search_job *job, struct pv *parent_pv,
                                struct position *position, int depth,
                                score_t alpha, score_t beta, int do_nullmove) {
   if (job->halt) return 0;
+  if (*job->stop) {
+    job->halt = 1;
+    return 0;
+  }
+  if (search_interrupt && job->interruptible) {
+    job->result.type = SEARCH_RESULT_INVALID;
+    job->halt = 1;
+    return 0;
+  }
 
-  ASSERT((job->depth - depth) < SEARCH_DEPTH_MAX);
   ASSERT(depth <= job->depth);
 
+  /* The PV is empty unless a move raises alpha, including on early returns */
+  parent_pv->length = 0;
+
   /* For statistics, count leaf nodes at horizon only (even if they extend) */
   if (depth == 0) job->result.n_leaf++;
   job->result.n_node++;
+  STAT(count_node(job, position, depth));
   if (job->next_time_check-- == 0) {
     job->next_time_check = NODES_PER_CHECK;
+    job->n_node_reported = job->result.n_node;
+    if (job->show_thoughts) {
+      show_thought(job, 0);
+      if (search_status_request) {
+        search_status_request = 0;
+        show_status(job);
+      }
+    }
+    if (job->pondering && !search_pondering) {
+      job->pondering = 0;
+      if (job->time_budget > 0.0)
+        job->stop_time = time_now() + job->time_budget - 0.01;
+    }
+    if (job->interruptible && search_node_limit &&
+        job->result.n_node >= search_node_limit) {
+      job->result.type = SEARCH_RESULT_INVALID;
+      job->halt = 1;
+      return 0;
+    }
     if (job->stop_time > job->start_time && time_now() > job->stop_time) {
       job->result.type = SEARCH_RESULT_INVALID;
       job->halt = 1;
-      printf("Time check\n");
       return 0;
     }
   }
@@ -219,121 +577,171 @@ static score_t search_position(struct search_job *job, struct pv *parent_pv,
 
   /* Breaking the 50-move rule or threefold repetition rule forces a draw */
   if (position->halfmove > 51 ||
-      is_repeated_position(job->history, position->hash, 3)) {
+      is_repeated_position(job->stack, position->hash, position->halfmove,
+                           3)) {
     if (depth == job->depth)
       job->result.type = SEARCH_RESULT_DRAW_BY_REPETITION;
     parent_pv->length = 0;
     return get_draw_score(position);
   }
 
+  /* The killer moves and move history are indexed by the ply from the root,
+     up to SEARCH_DEPTH_MAX.  A line this long can only be a run of checks and
+     captures, so stop there and return the static evaluation. */
+  int ply = position->ply - job->root_ply;
+  if (ply >= SEARCH_DEPTH_MAX - 1) return evaluate(position, &job->result);
+
   /* First phase - try to exit early */
 
   /* Principal variation for this node and its children */
   struct pv pv;
   pv.length = 0;
 
-  /* Null move pruning */
-  if (OPT_NULL && do_nullmove && depth <= job->depth - 2 && depth >= 2 &&
-      search_null(job, &pv, position, depth, alpha, beta))
-    return beta;
-
   /* If there are any moves, best_move and best_score will be updated by the end
      of the function */
   score_t best_score = -INVALID_SCORE;
-  struct move *best_move = 0;
-
-  /* Early exits in quiescence */
-  if (OPT_STAND_PAT && depth <= 0 && !in_check(position)) {
-    best_score = evaluate(position);
-    /* Standing pat - evaluate taking no action - this
-       could be better than the consequences of taking a piece. */
-    best_score = evaluate(position);
-    if (best_score >= beta) return beta;
-    if (best_score > alpha) alpha = best_score;
-  }
+  move_t best_move = NO_MOVE;
 
   /* Default node type - this will change to TT_EXACT on alpha update or TT_BETA
      on beta cutoff */
   enum tt_entry_type type = TT_ALPHA;
 
-  /* Try to get a beta cutoff or alpha update from a killer move */
-  if (OPT_KILLER && (depth >= 0) &&
-      !check_legality(position, &job->killer_moves[depth]) &&
-      search_move(job, parent_pv, &pv, position, depth, &best_score, &alpha,
-                  beta, &job->killer_moves[depth], &best_move, &type, 0, 0)) {
-    update_result(job, depth, &job->killer_moves[depth], best_score);
-    return beta;
-  }
-
   /* Probe the transposition table at higher levels */
+  struct tt_entry tt_buf;
   struct tt_entry *tte = 0;
-  if (OPT_HASH && depth > job->tt_min_depth)
-    tte = tt_probe(position->hash, position->total_a);
+  if (OPT_HASH && depth > job->tt_min_depth) {
+    job->result.tt_probes++;
+    if (tt_probe(position->hash, &tt_buf)) {
+      job->result.tt_hits++;
+      tte = &tt_buf;
+    }
+  }
 
   /* If the position has already been searched at the same or greater depth, use
-     the result from the tt.  Do not use this at the root, because the move that
+     the result from the tt if it is exact, or if it is a bound which falls
+     outside the window.  Do not use this at the root, because the move that
      will be made needs to be searched. */
-  if (tte && (tte->depth >= depth)) {
-    if (depth < job->depth) {
-      if (tte->type == TT_ALPHA && tte->score > alpha) return tte->score;
-      if (tte->type == TT_BETA && tte->score > beta) return beta;
-      if (tte->type == TT_EXACT) return tte->score;
+  if (tte && tte->depth >= depth && depth < job->depth) {
+    score_t score = score_from_tt(tte->score, job->depth - depth);
+    if (tte->type == TT_EXACT) {
+      STAT(job->result.stats.tt_cutoffs++);
+      return score;
+    }
+    if (tte->type == TT_ALPHA && score <= alpha) {
+      STAT(job->result.stats.tt_cutoffs++);
+      return alpha;
+    }
+    if (tte->type == TT_BETA && score >= beta) {
+      STAT(job->result.stats.tt_cutoffs++);
+      return beta;
     }
   }
 
-  /* If there is a valid best move from the transposition table, try to get a
-     beta cutoff or alpha update. */
-  int n_legal_moves = 0;
-  if (tte && !check_legality(position, &tte->best_move) &&
-      search_move(job, parent_pv, &pv, position, depth, &best_score, &alpha,
-                  beta, &tte->best_move, &best_move, &type, &n_legal_moves,
-                  0)) {
-    update_result(job, depth, &tte->best_move, best_score);
-    return beta;
+  /* Pruning is only tried away from the root and the principal variation, when
+     not in check and not near a mate score */
+  int pv_node = (beta - alpha > 1);
+  int can_prune = depth > 0 && depth < job->depth && !pv_node &&
+                  !in_check(position) &&
+                  abs(beta) < -CHECKMATE_SCORE - SEARCH_DEPTH_MAX;
+  score_t static_eval = 0;
+  if (can_prune && (razoring_enabled || null_move_enabled || futility_enabled))
+    static_eval = evaluate(position, &job->result);
+
+  /* Razoring - if the static evaluation is far below alpha near the horizon,
+     only captures are likely to recover, so drop into quiescence */
+  if (can_prune && razoring_enabled && depth <= RAZORING_MAX_DEPTH &&
+      static_eval + razoring_margin * depth <= alpha) {
+    job->result.prune[PRUNE_RAZORING].attempts++;
+    score_t score = search_position(job, &pv, position, 0, alpha, alpha + 1, 0);
+    if (job->halt) return 0;
+    if (score <= alpha) {
+      job->result.prune[PRUNE_RAZORING].cutoffs++;
+      return alpha;
+    }
   }
 
-  /* Second phase - generate and search all moves */
+  /* Null move pruning */
+  if (can_prune && null_move_enabled && do_nullmove && depth >= 2 &&
+      static_eval >= beta &&
+      has_non_pawn_material(position, position->turn) &&
+      search_null(job, &pv, position, depth, beta))
+    return beta;
 
-  /* Generate the list of pseudo-legal moves (including those leading into
-     self-check). list_entry will point to the first sorted item. */
-  struct move_list move_buf[N_MOVES];
-  struct move_list *list_entry = move_buf;
-  int n_pseudo_legal_moves;
-  if (depth > 0 || position->check[WHITE] || position->check[BLACK]) {
-    n_pseudo_legal_moves = generate_search_movelist(position, &list_entry);
-  } else {
-    /* No quiescence moves found - this is the bottom of the search.  Return
-     * evaluation. */
-    n_pseudo_legal_moves = generate_quiescence_movelist(position, &list_entry);
-    if (n_pseudo_legal_moves == 0)
-      return (OPT_STAND_PAT) ? best_score : evaluate(position);
+  /* Futility pruning - near the horizon, if the static evaluation is so far
+     below alpha that a quiet move is unlikely to make it up, quiet moves are
+     skipped once there is a legal move */
+  int futile = can_prune && futility_enabled && depth <= FUTILITY_MAX_DEPTH &&
+               static_eval + futility_margin * depth <= alpha;
+  if (futile) job->result.prune[PRUNE_FUTILITY].attempts++;
+
+  /* Early exits in quiescence */
+  if (OPT_STAND_PAT && depth <= 0 && !in_check(position)) {
+    /* Standing pat - evaluate taking no action - this
+       could be better than the consequences of taking a piece. */
+    best_score = evaluate(position, &job->result);
+    if (best_score >= beta) return beta;
+    if (best_score > alpha) alpha = best_score;
+  }
+
+  /* Second phase - search moves in the order given by the move picker: the TT
+     move, good captures, the killer move, quiet moves, then bad captures.  Each
+     stage is only generated if it is reached.  In quiescence, only captures
+     are searched. */
+  int quiescence = (depth <= 0 && !in_check(position));
+  move_t previous = (ply > 0) ? job->search_history[ply - 1] : NO_MOVE;
+  move_t countermove = NO_MOVE;
+  if (previous != NO_MOVE) {
+    enum square to = move_to(previous);
+    countermove = job->countermoves[(int)position->piece_at[to]][to];
   }
+  struct move_picker picker;
+  picker_init(&picker, position, tte ? tte->best_move : NO_MOVE,
+              OPT_KILLER ? job->killer_moves[ply] : 0, countermove,
+              job->butterfly[position->turn], quiescence);
 
-  /* Search through the list of pseudo-legal moves. search_move will update
+  /* Quiet moves searched without a cutoff, to lower their history scores if
+     a later quiet move causes one */
+  move_t quiets_tried[N_QUIETS_TRIED];
+  int n_quiets_tried = 0;
+
+  /* Search through the legal moves. search_move will update
      best_score, best_move, alpha, and type, and n_legal_moves. */
-  if (n_pseudo_legal_moves > 0) {
-    int is_late_move = 0;
-    while (list_entry) {
-      if (!(tte && move_equal(&tte->best_move, &list_entry->move))) {
-        if (depth > 3 && n_legal_moves > 1) is_late_move = 1;
-        if (search_move(job, parent_pv, &pv, position, depth, &best_score,
-                        &alpha, beta, &list_entry->move, &best_move, &type,
-                        &n_legal_moves, is_late_move)) {
-          update_result(job, depth, &list_entry->move, beta);
-          return beta;
-        }
-      }
-      list_entry = list_entry->next;
+  int n_legal_moves = 0;
+  move_t move;
+  while ((move = picker_next(&picker)) != NO_MOVE) {
+    int is_quiet = is_quiet_move(position, move);
+    if (search_move(job, parent_pv, &pv, position, depth, &best_score, &alpha,
+                    beta, move, &best_move, &type, &n_legal_moves,
+                    get_lmr_reduction(depth, n_legal_moves, pv_node),
+                    futile && n_legal_moves > 0)) {
+      job->result.n_cutoffs++;
+      if (n_legal_moves == 1) job->result.n_first_move_cutoffs++;
+      STAT(count_cutoff(job, n_legal_moves, quiescence));
+      if (is_quiet && depth > 0 && !job->halt)
+        update_quiet_ordering(job, position, ply, depth, move, quiets_tried,
+                              n_quiets_tried, previous);
+      update_result(job, depth, move, beta);
+      if (!job->halt && depth > job->tt_min_depth &&
+          !(depth == job->depth && job->n_excluded))
+        tt_update(position->hash, TT_BETA, depth,
+                  score_to_tt(beta, job->depth - depth), move, &job->result);
+      return beta;
     }
+    if (is_quiet && n_quiets_tried < N_QUIETS_TRIED)
+      quiets_tried[n_quiets_tried++] = move;
   }
 
+  /* No legal captures in quiescence - this is the bottom of the search.
+     Return the evaluation. */
+  if (quiescence && n_legal_moves == 0)
+    return (OPT_STAND_PAT) ? best_score : evaluate(position, &job->result);
+
   /* Checkmate or stalemate. For checkmate, reduce the score by the distance
      from root to mate. */
   if (n_legal_moves == 0) {
     type = TT_EXACT;
     if (in_check(position)) {
       alpha = CHECKMATE_SCORE + (job->depth - depth);
-      best_move = &mate_move;
     } else {
       alpha = get_draw_score(position);
     }
@@ -348,31 +756,250 @@ static score_t search_position(struct search_job *job, struct pv *parent_pv,
 
   ASSERT(alpha > -INVALID_SCORE && alpha < INVALID_SCORE);
 
+  STAT(count_node_type(job, type, quiescence));
+
   /* Update the result if at root */
+  if (depth == job->depth) job->n_root_moves = n_legal_moves;
   update_result(job, depth, best_move, alpha);
 
-  /* Update the transposition table at higher levels */
-  if (depth > job->tt_min_depth) {
-    tt_update(position->hash, type, depth, alpha, best_move, position->total_a);
+  /* Update the transposition table at higher levels.  A root search with moves
+     excluded does not give the result for the position. */
+  if (depth > job->tt_min_depth && !(depth == job->depth && job->n_excluded)) {
+    tt_update(position->hash, type, depth,
+              score_to_tt(alpha, job->depth - depth), best_move, &job->result);
   }
 
   return alpha;
 }
 
+/* Return the number of moves to checkmate for a mate score - positive if the
+   side to move mates, negative if it is mated - or 0 for any other score */
+int mate_distance(score_t score) {
+  if (score <= CHECKMATE_SCORE + SEARCH_DEPTH_MAX)
+    return -(score - CHECKMATE_SCORE + 1) / 2;
+  if (score >= -CHECKMATE_SCORE - SEARCH_DEPTH_MAX)
+    return (-CHECKMATE_SCORE - score + 1) / 2;
+  return 0;
+}
+
+/* Set the iteration depth for a search job */
+static inline void set_iteration_depth(struct search_job *job, int depth) {
+  job->depth = depth;
+  job->tt_min_depth = depth - 4;
+  if (job->tt_min_depth < 0) job->tt_min_depth = 0;
+  if (job->tt_min_depth > TT_MIN_DEPTH) job->tt_min_depth = TT_MIN_DEPTH;
+}
+
+/* Exclude the root moves which the caller gave in `search_excluded` */
+static void exclude_root_moves(struct search_job *job) {
+  int n = search_n_excluded;
+  if (n < 0) n = 0;
+  if (n > MULTI_PV_MAX) n = MULTI_PV_MAX;
+  memcpy(job->excluded, search_excluded, n * sizeof(job->excluded[0]));
+  job->n_excluded = job->n_root_excluded = n;
+}
+
+/*
+ *  Lazy SMP
+ *
+ *  Helper threads run their own iterative deepening loops alongside the main
+ *  thread, each on a private copy of the position with its own search stack
+ *  and killer moves.  The game history is only read during the search.  The
+ *  only thing they share is the transposition table, so the main thread
+ *  benefits from the entries they store.  Odd-numbered helpers start one ply
+ *  deeper to diversify the search.  The main thread owns the result and the
+ *  time checks, and stops the helpers when it finishes.
+ */
+
+/* Everything a helper thread needs to search independently */
+struct search_helper {
+  struct search_job job;
+  struct position position;
+  struct search_stack stack;
+  int min_depth;
+  int max_depth;
+  struct thread *thread;
+};
+
+/* Helper thread entry point - iterative deepening until stopped */
+static void run_helper(void *arg) {
+  struct search_helper *helper = (struct search_helper *)arg;
+  struct search_job *job = &helper->job;
+  for (int depth = helper->min_depth; depth < helper->max_depth && !job->halt;
+       depth++) {
+    set_iteration_depth(job, depth);
+    struct pv pv;
+    search_position(job, &pv, &helper->position, job->depth, -INVALID_SCORE,
+                    INVALID_SCORE, 1);
+  }
+}
+
+/* Return the nodes searched by the main thread and its helpers, counting each
+ * helper's nodes as it last reported them */
+static int count_all_nodes(const struct search_job *job) {
+  int n_node = job->result.n_node;
+  for (int i = 0; i < job->n_helpers; i++)
+    n_node += job->helpers[i].job.n_node_reported;
+  return n_node;
+}
+
+/* Start `n_helpers` helper threads searching from `position`.  Return the
+ * array of helpers, which may be zero if there are none. */
+static struct search_helper *start_helpers(int n_helpers, int min, int max,
+                                           volatile int *stop,
+                                           const struct history *history,
+                                           const struct position *position) {
+  if (n_helpers < 1) return 0;
+  struct search_helper *helpers =
+      (struct search_helper *)calloc(n_helpers, sizeof(*helpers));
+  if (!helpers) return 0;
+  for (int i = 0; i < n_helpers; i++) {
+    struct search_helper *helper = &helpers[i];
+    helper->job.start_time = time_now();
+    helper->job.stop = stop;
+    helper->job.stack = &helper->stack;
+    helper->job.root_ply = position->ply;
+    exclude_root_moves(&helper->job);
+    copy_position(&helper->position, position);
+    stack_init(&helper->stack, history);
+    helper->min_depth = min + ((i & 1) ? 1 : 0);
+    helper->max_depth = max;
+    helper->thread = thread_create(run_helper, helper);
+  }
+  return helpers;
+}
+
+/* Stop and wait for helper threads, adding their node counts to `res` */
+static void stop_helpers(struct search_helper *helpers, int n_helpers,
+                         volatile int *stop, struct search_result *res) {
+  if (!helpers) return;
+  *stop = 1;
+  for (int i = 0; i < n_helpers; i++) {
+    if (!helpers[i].thread) continue;
+    thread_join(helpers[i].thread);
+    res->n_leaf += helpers[i].job.result.n_leaf;
+    res->n_node += helpers[i].job.result.n_node;
+    res->tt_probes += helpers[i].job.result.tt_probes;
+    res->tt_hits += helpers[i].job.result.tt_hits;
+    res->tt_updates += helpers[i].job.result.tt_updates;
+    res->tt_collisions += helpers[i].job.result.tt_collisions;
+    res->n_moves_generated += helpers[i].job.result.n_moves_generated;
+    res->n_moves_avoided += helpers[i].job.result.n_moves_avoided;
+    res->pawn_hash_probes += helpers[i].job.result.pawn_hash_probes;
+    res->pawn_hash_hits += helpers[i].job.result.pawn_hash_hits;
+    res->n_pvs_researches += helpers[i].job.result.n_pvs_researches;
+    res->n_cutoffs += helpers[i].job.result.n_cutoffs;
+    res->n_first_move_cutoffs += helpers[i].job.result.n_first_move_cutoffs;
+    for (int j = 0; j < N_PRUNE_T; j++) {
+      res->prune[j].attempts += helpers[i].job.result.prune[j].attempts;
+      res->prune[j].cutoffs += helpers[i].job.result.prune[j].cutoffs;
+      res->prune[j].researches += helpers[i].job.result.prune[j].researches;
+    }
+    STAT(add_stats(&res->stats, &helpers[i].job.result.stats));
+  }
+  free(helpers);
+}
+
+/* Search the root at the iteration depth.  After the first iteration, search
+   a window around the previous score, which is cheaper than a full window.  If
+   the score falls outside it, widen the window on that side and search
+   again. */
+static score_t search_root(struct search_job *job, struct pv *pv,
+                           struct position *position, int use_window,
+                           score_t last_score) {
+  score_t score;
+  score_t window = aspiration_window;
+  score_t alpha = -INVALID_SCORE, beta = INVALID_SCORE;
+  if (window && use_window &&
+      abs(last_score) < -CHECKMATE_SCORE - SEARCH_DEPTH_MAX) {
+    alpha = last_score - window;
+    beta = last_score + window;
+  }
+  for (;;) {
+    score = search_position(job, pv, position, job->depth, alpha, beta, 1);
+    if (job->halt) break;
+    window *= 4;
+    if (score <= alpha && alpha > -INVALID_SCORE) {
+      alpha = (window < INFINITY_SCORE) ? score - window : -INVALID_SCORE;
+    } else if (score >= beta && beta < INVALID_SCORE) {
+      beta = (window < INFINITY_SCORE) ? score + window : INVALID_SCORE;
+    } else {
+      break;
+    }
+    job->result.n_aspiration_researches++;
+  }
+  return score;
+}
+
+/* Multi-PV - search the root again for each line after the first, excluding
+   the root moves of the lines already found.  The transposition table keeps
+   the results of the earlier passes, so each pass costs much less than a
+   separate search.  `pvs` and `scores` hold the first line, and receive the
+   others, sorted best first.  Return 0 if the search was halted. */
+static int search_lines(struct search_job *job, struct position *position,
+                        int use_window, struct pv *pvs, score_t *scores) {
+  job->n_excluded = job->n_root_excluded;
+  for (int i = 1; i < job->multi_pv && !job->halt; i++) {
+    job->excluded[job->n_excluded++] = pvs[i - 1].moves[0];
+    scores[i] = search_root(job, &pvs[i], position, use_window, scores[i]);
+  }
+  job->n_excluded = job->n_root_excluded;
+  if (job->halt) return 0;
+
+  /* A pass may score higher than the one before it, as the windows differ.
+     Sort the lines, so that one which beats the first pass becomes the best
+     line.  Equal scores keep their order. */
+  for (int i = 1; i < job->multi_pv; i++) {
+    for (int j = i; j > 0 && scores[j] > scores[j - 1]; j--) {
+      struct pv pv = pvs[j];
+      score_t score = scores[j];
+      pvs[j] = pvs[j - 1];
+      scores[j] = scores[j - 1];
+      pvs[j - 1] = pv;
+      scores[j - 1] = score;
+    }
+  }
+  return 1;
+}
+
+/* Show each line of a multi-PV iteration */
+static void show_lines(struct search_job *job, const struct pv *pvs,
+                       const score_t *scores) {
+  for (int i = 0; i < job->multi_pv; i++) {
+    memcpy(job->thought_pv, &pvs[i], sizeof(*job->thought_pv));
+    job->thought_score = scores[i];
+    job->thought_depth = job->depth;
+    job->thought_line = i;
+    job->thought_pending = 1;
+    show_thought(job, 1);
+  }
+  job->thought_line = 0;
+}
+
 /* Perform a search */
 void search(int target_depth, double time_budget, double time_margin,
-            struct history *history, struct position *position,
+            const struct history *history, struct position *position,
             struct search_result *res, int show_thoughts) {
   /* Prepare for search */
+  volatile int stop = 0;
   struct search_job job;
   memset(&job, 0, sizeof(job));
   job.start_time = time_now();
-  job.history = history;
+  job.stop = &stop;
+  struct search_stack stack;
+  stack_init(&stack, history);
+  job.stack = &stack;
+  job.root_ply = position->ply;
   job.show_thoughts = show_thoughts;
-  tt_zero();
-
-  double remaining_time_budget = time_budget;
-
+  struct pv thought_pv;
+  job.thought_pv = &thought_pv;
+  copy_position(&job.root_position, position);
+  exclude_root_moves(&job);
+  tt_resize();
+  evaluate_prepare(position);
+  build_lmr_table();
+
+  if (target_depth > MAX_TARGET_DEPTH) target_depth = MAX_TARGET_DEPTH;
   int min, max;
   if (target_depth == 0) {
     /* Search based on `time_budget` */
@@ -390,39 +1017,94 @@ void search(int target_depth, double time_budget, double time_margin,
     max = target_depth + 1;
     job.stop_time = job.start_time + time_budget - 0.01;
   }
-
+  if (job.stop_time > 0.0) job.time_budget = time_budget;
+  job.pondering = search_pondering;
+  if (job.pondering) job.stop_time = 0.0;
+
+  /* Shallow searches are not worth the cost of starting threads */
+  int n_helpers = (max - min > 1) ? search_threads - 1 : 0;
+  struct search_helper *helpers =
+      start_helpers(n_helpers, min, max, &stop, history, position);
+  job.helpers = helpers;
+  job.n_helpers = helpers ? n_helpers : 0;
+
+  score_t last_scores[MULTI_PV_MAX] = {0};
+  struct pv line_pvs[MULTI_PV_MAX];
+  job.multi_pv = search_multi_pv;
   for (int depth = min; depth < max; depth++) {
     double iteration_start_time = time_now();
-    job.depth = depth;
-    job.tt_min_depth = depth - 4;
-    if (job.tt_min_depth < 0) job.tt_min_depth = 0;
-    if (job.tt_min_depth > TT_MIN_DEPTH) job.tt_min_depth = TT_MIN_DEPTH;
+    set_iteration_depth(&job, depth);
 
     /* Enter recursive search with the current position as the root */
     struct pv pv;
-    score_t score = search_position(&job, &pv, position, job.depth,
-                                    -INVALID_SCORE, INVALID_SCORE, 1);
-
+    score_t score =
+        search_root(&job, &pv, position, depth > min, last_scores[0]);
     if (job.result.type == SEARCH_RESULT_INVALID) break;
+    last_scores[0] = score;
+
+    /* Search for the further lines of a multi-PV search.  The number of legal
+       root moves is known after the first iteration. */
+    if (depth == min && job.multi_pv > job.n_root_moves)
+      job.multi_pv = job.n_root_moves;
+    memcpy(&line_pvs[0], &pv, sizeof(line_pvs[0]));
+    if (job.multi_pv > 1) {
+      move_t best_move = job.best_move;
+      if (!search_lines(&job, position, depth > min, line_pvs, last_scores))
+        break;
+      /* The best move and score come from the first line, which is only a
+         later pass if that pass scored higher */
+      if (last_scores[0] > score) {
+        best_move = line_pvs[0].moves[0];
+        score = last_scores[0];
+      }
+      job.best_move = best_move;
+      job.result.score = score;
+    }
 
-    /* Copy results and calculate stats */
+    /* Copy results and calculate stats.  Once there is a result, the search
+       can be interrupted. */
     memcpy(res, &job.result, sizeof(*res));
+    job.interruptible = 1;
+    if (res->type == SEARCH_RESULT_CHECKMATE)
+      res->move = mate_move;
+    else
+      describe_move(position, job.best_move, &res->move);
+    memset(&res->ponder_move, 0, sizeof(res->ponder_move));
+    if (line_pvs[0].length > 1 && line_pvs[0].moves[0] == job.best_move)
+      decode_move(line_pvs[0].moves[1], &res->ponder_move);
     double branching_factor = pow((double)res->n_leaf, 1.0 / (double)depth);
     double iteration_time = time_now() - iteration_start_time;
-    remaining_time_budget -= iteration_time;
 
     res->branching_factor = branching_factor;
     res->time = time_now() - job.start_time;
-    res->collisions = tt_collisions();
+    res->n_lines = job.multi_pv;
+    for (int i = 0; i < job.multi_pv; i++) {
+      res->lines[i].score = last_scores[i];
+      res->lines[i].length = line_pvs[i].length;
+      memcpy(res->lines[i].moves, line_pvs[i].moves,
+             line_pvs[i].length * sizeof(line_pvs[i].moves[0]));
+    }
+    if (job.show_thoughts && job.multi_pv > 1)
+      show_lines(&job, line_pvs, last_scores);
 
     /* Break if a checkmate to either side has been found within depth */
     if (abs(score) + depth >= -CHECKMATE_SCORE) break;
 
-    /* Estimate whether there is enough time for another iteration */
+    /* Estimate whether there is enough time for another iteration.  The time
+       budget starts when pondering stops. */
     double predicted_next_iteration_time = iteration_time * branching_factor;
-    if (target_depth == 0 && predicted_next_iteration_time >
-                                 remaining_time_budget * (1.0 + time_margin))
+    double remaining_time_budget = job.stop_time + 0.01 - time_now();
+    if (target_depth == 0 && !job.pondering &&
+        predicted_next_iteration_time >
+            remaining_time_budget * (1.0 + time_margin))
       break;
   }
+  if (!job.halt) show_thought(&job, 1);
+  job.helpers = 0;
+  job.n_helpers = 0;
+  stop_helpers(helpers, n_helpers, &stop, res);
+  res->collisions = res->tt_updates ? (double)res->tt_collisions * 100.0 /
+                                          (double)res->tt_updates
+                                    : 0.0;
   tt_new_age();
 }
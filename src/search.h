@@ -18,15 +18,86 @@ struct move_list {
   struct move_list *next;
 };
 
+/* Pruning and reduction techniques */
+enum prune_type {
+  PRUNE_NULL_MOVE,
+  PRUNE_LMR,
+  PRUNE_FUTILITY,
+  PRUNE_RAZORING,
+  N_PRUNE_T
+};
+
+/* Counters for a pruning technique - how often it was tried, how often it cut
+ * off or shortened a search, and how often a result had to be checked by
+ * searching again */
+struct prune_stats {
+  long long attempts;
+  long long cutoffs;
+  long long researches;
+};
+
+/* SEARCH_DEPTH_MAX - Estimate - if depth = 20 and there is an alternation of
+ * check and quiescence moves.  There are 32 pieces, 29 can be taken, +29 check
+ * evasions = 58, +depth.
+ * N_MOVES - Max moves possible in a position.  This has been studied. */
+enum {
+  SEARCH_DEPTH_MAX = 60,
+  N_MOVES = 218,
+  MAX_THREADS = 64,
+  N_KILLERS = 2,        /* Killer moves kept for each ply */
+  HISTORY_MAX = 16384,  /* Limit of the history heuristic scores */
+  MULTI_PV_MAX = 16,    /* Most lines found by a multi-PV search */
+  N_CUTOFF_INDEX = 8,   /* Move numbers counted apart in cutoff statistics */
+};
+
+/* One of the best lines from the root, found by a multi-PV search */
+struct search_line {
+  score_t score;
+  int length; /* Moves in the principal variation */
+  move_t moves[SEARCH_DEPTH_MAX];
+};
+
+/* Detailed statistics, only counted when built with SEARCH_STATS.  Nodes which
+ * search their moves are counted by whether they fail high (cut), fail low
+ * (all) or return a score inside the window (PV). */
+struct search_stats {
+  long long pv_nodes;
+  long long cut_nodes;
+  long long all_nodes;
+  long long quiescence_nodes; /* Nodes at or below the horizon */
+  long long tt_cutoffs;       /* Nodes which return the score of a TT entry */
+  /* Beta cutoffs by the number of the legal move which caused them, the last
+     counting all later moves */
+  long long cutoff_index[N_CUTOFF_INDEX];
+  long long ply_nodes[SEARCH_DEPTH_MAX]; /* Nodes at each ply from the root */
+};
+
 struct search_result {
   score_t score;
   int n_leaf;
   int n_node;
-  int n_check_moves;
   int seldep;
+  long long tt_probes;
+  long long tt_hits;
+  long long tt_updates;
+  long long tt_collisions; /* Updates replacing another current position */
+  long long n_moves_generated; /* Positions where all moves were calculated */
+  long long n_moves_avoided;   /* Positions searched without calculating them */
+  long long pawn_hash_probes;
+  long long pawn_hash_hits;
+  long long n_pvs_researches;        /* Null window searches which failed */
+  long long n_aspiration_researches; /* Root searches outside the window */
+  struct prune_stats prune[N_PRUNE_T];
+  long long n_cutoffs;            /* Beta cutoffs in the move loop */
+  long long n_first_move_cutoffs; /* ...of which by the first legal move */
+  struct search_stats stats;
   double branching_factor;
-  double collisions;
+  double collisions; /* Percentage of TT updates which were collisions */
   struct move move;
+  struct move ponder_move; /* Expected reply from the PV, or from == to */
+  /* Best lines of the last complete iteration, best first */
+  int n_lines;
+  struct search_line lines[MULTI_PV_MAX];
   enum {
     SEARCH_RESULT_INVALID,
     SEARCH_RESULT_PLAY,
@@ -37,39 +108,86 @@ struct search_result {
   double time;
 };
 
-/* SEARCH_DEPTH_MAX - Estimate - if depth = 20 and there is an alternation of
- * check and quiescence moves.  There are 32 pieces, 29 can be taken, +29 check
- * evasions = 58, +depth.
- * REPEAT_HISTORY_SIZE - Estimate - this needs to be the expected max length of
- * a game + max expected depth.
- * N_MOVES - Max moves possible in a position.  This has been studied. */
-enum {
-  SEARCH_DEPTH_MAX = 60,
-  REPEAT_HISTORY_SIZE = 300,
-  N_MOVES = 218,
-};
 
 struct history;
+struct search_stack;
+struct search_helper;
+struct pv;
 struct search_job {
   /* Parameters */
-  int depth; /* Search depth before quiescence */
-  int halt;  /* Halt search */
+  int depth;          /* Search depth before quiescence */
+  int halt;           /* Halt search */
+  volatile int *stop; /* Shared flag to halt all threads of a search */
+  int interruptible;  /* `search_interrupt` is obeyed */
+  int pondering;      /* No time limit until `search_pondering` is cleared */
+  double time_budget; /* Time allowed once pondering stops, or 0 */
   int show_thoughts;
   int tt_min_depth;
   /* position */
+  struct position root_position; /* Copy of the root, to describe moves */
   double start_time;
-  struct move search_history[SEARCH_DEPTH_MAX];
-  struct history *history;
-  struct move killer_moves[SEARCH_DEPTH_MAX];
+  int root_ply;                            /* `position->ply` at root */
+  move_t search_history[SEARCH_DEPTH_MAX]; /* Move made at each ply */
+  struct search_stack *stack; /* Positions since the root, for repetitions */
+  /* Quiet move ordering - the latest quiet moves to cause a cutoff at each ply,
+     the quiet move which last refuted each move, by the piece moved and its
+     destination, and history heuristic scores for each player's moves by from
+     and to square */
+  move_t killer_moves[SEARCH_DEPTH_MAX][N_KILLERS];
+  move_t countermoves[N_PLANES][N_SQUARES];
+  int butterfly[N_PLAYERS][N_SQUARES][N_SQUARES];
   int n_ai_moves;
   int next_time_check;
   double stop_time;
+  /* Progress at the root, for status requests */
+  move_t root_move;     /* Root move being searched */
+  int root_move_number; /* ...counting legal moves from 1 */
+  int n_root_moves;     /* Legal root moves in the last iteration */
+  /* Multi-PV - each iteration searches the root `multi_pv` times, excluding
+     the root moves of the lines already found, after any excluded by the
+     caller */
+  int multi_pv;
+  move_t excluded[2 * MULTI_PV_MAX];
+  int n_excluded;
+  int n_root_excluded; /* Moves excluded by the caller, first in `excluded` */
+  /* The latest thought, waiting to be shown at a limited rate */
+  struct pv *thought_pv;
+  score_t thought_score;
+  int thought_depth;
+  int thought_line; /* Multi-PV line, counting from 0 */
+  int thought_pending;
+  double next_thought_time;
+  /* Lazy SMP - the main thread's helpers, so that thoughts can count their
+     nodes, and the nodes a helper has searched as last reported by it */
+  struct search_helper *helpers;
+  int n_helpers;
+  volatile int n_node_reported;
   /* Results */
+  move_t best_move; /* Best move at the root */
   struct search_result result;
 };
 
+extern int search_threads;
+extern int pvs_enabled;
+extern int aspiration_window;
+extern volatile int search_interrupt;
+extern volatile int search_pondering;
+extern volatile int search_status_request;
+extern double search_thought_interval;
+extern long long search_node_limit;
+extern int search_multi_pv;
+extern move_t search_excluded[MULTI_PV_MAX];
+extern int search_n_excluded;
+
+/* Shows a thought - the principal variation when it changes at the root */
+typedef void (*thought_fn)(struct search_job *job, struct pv *pv, int depth,
+                           score_t score, double time, int nodes, double knps,
+                           int seldep);
+extern thought_fn search_thought;
+
 void search(int target_depth, double time_budget, double time_margin,
-            struct history *history, struct position *position,
+            const struct history *history, struct position *position,
             struct search_result *result, int show_thoughts);
+int mate_distance(score_t score);
 
 #endif  // SEARCH_H
@@ -0,0 +1,401 @@
+/*
+ *  UCI Interface
+ *
+ *  Entered with the `uci` command, after which commands are read a line at a
+ *  time until `quit`.  Searches run on the main thread.  The commands which
+ *  control a running search - `stop`, `ponderhit`, `isready` and `quit` - are
+ *  handled as they arrive by the input thread.
+ */
+
+#include "uci.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "buildinfo/buildinfo.h"
+#include "clock.h"
+#include "engine.h"
+#include "fen.h"
+#include "hash.h"
+#include "history.h"
+#include "io.h"
+#include "options.h"
+#include "pv.h"
+#include "search.h"
+
+enum { UCI_LINE_SIZE = 4096, UCI_INFO_SIZE = 1024 };
+
+/* Search state shared with the input thread */
+static volatile int searching; /* From `go` until `bestmove` is sent */
+static volatile int stopped;   /* `stop` or `quit` arrived while searching */
+static int quitting;
+
+/*
+ *  Parsing
+ */
+
+/* Return the next whitespace-delimited token in `*ptr`, terminating it and
+ * advancing `*ptr` past it.  Return 0 if there are no more tokens. */
+static char *next_token(char **ptr) {
+  char *p = *ptr;
+  while (isspace((unsigned char)*p)) p++;
+  if (*p == 0) {
+    *ptr = p;
+    return 0;
+  }
+  char *token = p;
+  while (*p && !isspace((unsigned char)*p)) p++;
+  if (*p) *p++ = 0;
+  *ptr = p;
+  return token;
+}
+
+/*
+ *  Output
+ */
+
+/* Show a thought as an `info` line */
+static void uci_thought(struct search_job *job, struct pv *pv, int depth,
+                        score_t score, double time, int nodes, double knps,
+                        int seldep) {
+  char buf[UCI_INFO_SIZE];
+  int mate = mate_distance(score);
+  int nps = (time > 0.0) ? (int)(nodes / time) : 0;
+  int len = snprintf(buf, sizeof(buf), "info depth %d seldepth %d", depth,
+                     seldep);
+  if (job->multi_pv > 1)
+    len += snprintf(buf + len, sizeof(buf) - len, " multipv %d",
+                    job->thought_line + 1);
+  len += snprintf(buf + len, sizeof(buf) - len,
+                  " score %s %d nodes %d nps %d hashfull %d time %d pv",
+                  mate ? "mate" : "cp", mate ? mate : score,
+                  nodes, nps, tt_hashfull(),
+                  (int)(time * 1000.0));
+  for (int i = 0; i < pv->length && len < (int)sizeof(buf) - 10; i++) {
+    char move_buf[10];
+    struct move move;
+    decode_move(pv->moves[i], &move);
+    format_move(move_buf, &move, 1);
+    len += snprintf(buf + len, sizeof(buf) - len, " %s", move_buf);
+  }
+  snprintf(buf + len, sizeof(buf) - len, "\n");
+  /* A single write, so that the line can't be split by `readyok` */
+  fputs(buf, stdout);
+}
+
+/* Send the result of a search */
+static void send_bestmove(struct search_result *result) {
+  char move_buf[10];
+  char ponder_buf[10];
+  if (result->type != SEARCH_RESULT_PLAY) {
+    fputs("bestmove 0000\n", stdout);
+    return;
+  }
+  format_move(move_buf, &result->move, 1);
+  if (result->ponder_move.from != result->ponder_move.to) {
+    format_move(ponder_buf, &result->ponder_move, 1);
+    printf("bestmove %s ponder %s\n", move_buf, ponder_buf);
+  } else {
+    printf("bestmove %s\n", move_buf);
+  }
+}
+
+/*
+ *  Commands
+ */
+
+static int process_line(struct engine *engine);
+
+/* Identify the engine and list its options */
+static void uci_uci(struct engine *engine, char *args) {
+  printf("id name %s\n", app_name);
+  printf("id author Joe Dlugosz\n");
+  printf("option name Ponder type check default false\n");
+  list_uci_options();
+  printf("uciok\n");
+}
+
+static void uci_isready(struct engine *engine, char *args) {
+  printf("readyok\n");
+}
+
+/* Clear everything learnt from the last game */
+static void uci_ucinewgame(struct engine *engine, char *args) {
+  reset_board(&engine->game);
+  history_clear(&engine->history);
+  tt_resize();
+  tt_clear();
+}
+
+/* Set an option - "name <id> [value <x>]".  Check box values are "true" or
+ * "false". */
+static void uci_setoption(struct engine *engine, char *args) {
+  char *name = strstr(args, "name ");
+  if (!name) return;
+  name += 5;
+  while (isspace((unsigned char)*name)) name++;
+  const char *val_txt = "";
+  char *value = strstr(name, " value ");
+  if (value) {
+    *value = 0;
+    val_txt = value + 7;
+    while (isspace((unsigned char)*val_txt)) val_txt++;
+  }
+  char *end = name + strlen(name);
+  while (end > name && isspace((unsigned char)end[-1])) *--end = 0;
+
+  if (strcmp(val_txt, "true") == 0) val_txt = "1";
+  if (strcmp(val_txt, "false") == 0) val_txt = "0";
+
+  /* The GUI decides when to ponder */
+  if (strcmp(name, "Ponder") == 0) return;
+  if (set_option_value(engine, name, val_txt))
+    printf("info string Option not accepted: %s\n", name);
+}
+
+/* Set up a position - "[startpos | fen <fen>] [moves <move> ...]" */
+static void uci_position(struct engine *engine, char *args) {
+  char *token = next_token(&args);
+  if (!token) return;
+  if (strcmp(token, "startpos") == 0) {
+    reset_board(&engine->game);
+    token = next_token(&args);
+  } else if (strcmp(token, "fen") == 0) {
+    /* The move counters are optional */
+    char *fields[6] = {0, 0, 0, 0, "0", "1"};
+    int n_fields = 0;
+    while ((token = next_token(&args)) && strcmp(token, "moves") != 0) {
+      if (n_fields < 6) fields[n_fields++] = token;
+    }
+    if (n_fields < 4 || load_fen(&engine->game, fields[0], fields[1],
+                                 fields[2], fields[3], fields[4], fields[5])) {
+      printf("info string FEN not recognised\n");
+      return;
+    }
+  } else {
+    return;
+  }
+  history_clear(&engine->history);
+
+  if (!token || strcmp(token, "moves") != 0) return;
+  while ((token = next_token(&args))) {
+    struct move move;
+    if (parse_move(token, &move) || check_legality(&engine->game, &move)) {
+      printf("info string Illegal move %s\n", token);
+      return;
+    }
+    history_push(&engine->history, engine->game.hash);
+    make_move(&engine->game, &move);
+    change_player(&engine->game);
+  }
+}
+
+/* Search the current position and send the best move - "[wtime <ms>]
+ * [btime <ms>] [winc <ms>] [binc <ms>] [movestogo <n>] [movetime <ms>]
+ * [depth <n>] [nodes <n>] [infinite] [ponder]".  `searchmoves` and `mate` are
+ * ignored. */
+static void uci_go(struct engine *engine, char *args) {
+  double time[N_PLAYERS] = {0.0, 0.0};
+  double increment[N_PLAYERS] = {0.0, 0.0};
+  double move_time = 0.0;
+  int has_time = 0;
+  int moves_to_go = 0;
+  int depth = 0;
+  long long nodes = 0;
+  int infinite = 0;
+  int ponder = 0;
+
+  char *token;
+  while ((token = next_token(&args))) {
+    if (strcmp(token, "infinite") == 0) {
+      infinite = 1;
+    } else if (strcmp(token, "ponder") == 0) {
+      ponder = 1;
+    } else if (strcmp(token, "wtime") == 0 || strcmp(token, "btime") == 0 ||
+               strcmp(token, "winc") == 0 || strcmp(token, "binc") == 0 ||
+               strcmp(token, "movestogo") == 0 ||
+               strcmp(token, "movetime") == 0 ||
+               strcmp(token, "depth") == 0 || strcmp(token, "nodes") == 0) {
+      char *value = next_token(&args);
+      if (!value) break;
+      if (strcmp(token, "wtime") == 0) {
+        time[WHITE] = atof(value) / 1000.0;
+        has_time = 1;
+      } else if (strcmp(token, "btime") == 0) {
+        time[BLACK] = atof(value) / 1000.0;
+        has_time = 1;
+      } else if (strcmp(token, "winc") == 0) {
+        increment[WHITE] = atof(value) / 1000.0;
+      } else if (strcmp(token, "binc") == 0) {
+        increment[BLACK] = atof(value) / 1000.0;
+      } else if (strcmp(token, "movestogo") == 0) {
+        moves_to_go = atoi(value);
+      } else if (strcmp(token, "movetime") == 0) {
+        move_time = atof(value) / 1000.0;
+      } else if (strcmp(token, "depth") == 0) {
+        depth = atoi(value);
+      } else if (strcmp(token, "nodes") == 0) {
+        nodes = atoll(value);
+      }
+    }
+  }
+
+  /* Work out the time budget with the same clock as XBoard mode, or search
+   * without a time limit */
+  enum player turn = engine->game.turn;
+  double time_budget = INFINITY;
+  double time_margin = 0.0;
+  if (!infinite && (move_time > 0.0 || has_time)) {
+    struct clock clock;
+    memset(&clock, 0, sizeof(clock));
+    if (move_time > 0.0) {
+      clock.mode = TIME_CTRL_FIXED;
+      clock.increment_seconds = move_time;
+    } else if (moves_to_go > 0) {
+      clock.mode = TIME_CTRL_CLASSICAL;
+      clock.time_control = time[turn];
+      clock.moves_per_session = moves_to_go;
+      clock.moves_remaining[turn] = moves_to_go;
+      clock.time_remaining[turn] = time[turn];
+    } else {
+      clock.mode = TIME_CTRL_INCREMENTAL;
+      clock.increment_seconds = increment[turn];
+      clock.time_remaining[turn] = time[turn];
+    }
+    time_budget = clock_get_time_budget(&clock, turn);
+    time_margin = clock_get_time_margin(&clock);
+    /* Don't risk the whole clock on one move */
+    if (has_time && move_time == 0.0)
+      time_budget = fmin(time_budget, time[turn] / 2.0);
+  }
+
+  /* `search_pondering` was set by the input thread when `go` arrived, and
+   * cleared if `ponderhit` has arrived since */
+  struct search_result *result = &engine->last_result;
+  memset(result, 0, sizeof(*result));
+  search_node_limit = nodes;
+  search(depth, time_budget, time_margin, &engine->history, &engine->game,
+         result, 1);
+  search_node_limit = 0;
+
+  /* An infinite search, or one still pondering, waits to be told before
+   * sending its move */
+  while ((infinite || (ponder && search_pondering)) && !stopped) {
+    if (process_line(engine)) break;
+  }
+  searching = 0;
+  send_bestmove(result);
+}
+
+static void uci_quit(struct engine *engine, char *args) { quitting = 1; }
+
+/* Not part of UCI - print the statistics of the last search */
+static void uci_stats(struct engine *engine, char *args) {
+  print_search_stats(&engine->last_result);
+}
+
+static void uci_noop(struct engine *engine, char *args) {}
+
+/*
+ *  Command Table
+ */
+
+typedef void (*uci_fn)(struct engine *engine, char *args);
+
+/* Entry in the table of commands */
+struct uci_command {
+  char cmd[20];
+  uci_fn fn;
+};
+
+/* Table of commands */
+static const struct uci_command uci_cmds[] = {
+    /* clang-format off */
+  { "debug",      uci_noop       },
+  { "go",         uci_go         },
+  { "isready",    uci_isready    },
+  { "ponderhit",  uci_noop       },
+  { "position",   uci_position   },
+  { "quit",       uci_quit       },
+  { "setoption",  uci_setoption  },
+  { "stats",      uci_stats      },
+  { "stop",       uci_noop       },
+  { "uci",        uci_uci        },
+  { "ucinewgame", uci_ucinewgame },
+    /* clang-format on */
+};
+
+/* Number of commands */
+enum { N_UCI_CMDS = sizeof(uci_cmds) / sizeof(*uci_cmds) };
+
+/* Read and process a line of input.  Return nonzero at the end of input. */
+static int process_line(struct engine *engine) {
+  char line[UCI_LINE_SIZE];
+  strncpy(line, get_delim('\n'), sizeof(line) - 1);
+  line[sizeof(line) - 1] = 0;
+  if (line[0] == 0 && input_eof()) return 1;
+
+  char *args = line;
+  char *cmd = next_token(&args);
+  if (!cmd) return 0;
+  for (int i = 0; i < N_UCI_CMDS; i++) {
+    if (strcmp(cmd, uci_cmds[i].cmd) == 0) {
+      uci_cmds[i].fn(engine, args);
+      return 0;
+    }
+  }
+  printf("info string Unknown command %s\n", cmd);
+  return 0;
+}
+
+/* Called on the input thread with each line read after `uci`.  `go` resets
+ * the search controls, so that commands which arrive after it act on the new
+ * search.
+ * While searching, `stop`, `quit` and `ponderhit` take effect at once, and
+ * are queued as well so that a search waiting for them can see them.
+ * `isready` is answered at once. */
+int uci_input_filter(const char *line) {
+  char cmd[20];
+  if (sscanf(line, "%19s", cmd) != 1) return 1;
+  if (strcmp(cmd, "go") == 0) {
+    stopped = 0;
+    search_interrupt = 0;
+    search_pondering = (strstr(line, " ponder") != 0);
+    searching = 1;
+    return 1;
+  }
+  if (!searching) return 1;
+  if (strcmp(cmd, "isready") == 0) {
+    fputs("readyok\n", stdout);
+    return 0;
+  }
+  if (strcmp(cmd, "stop") == 0 || strcmp(cmd, "quit") == 0) {
+    stopped = 1;
+    search_interrupt = 1;
+  } else if (strcmp(cmd, "ponderhit") == 0) {
+    search_pondering = 0;
+  }
+  return 1;
+}
+
+/*
+ *  Run
+ */
+
+/* Answer the `uci` command which selected this protocol, then process UCI
+ * commands until `quit` or the end of input */
+void run_uci(struct engine *engine) {
+  /* End an interactive prompt, and stop further console output */
+  if (!engine->xboard_mode) printf("\n");
+  engine->xboard_mode = 1;
+  search_thought = uci_thought;
+
+  uci_uci(engine, 0);
+  while (!quitting) {
+    if (process_line(engine)) break;
+  }
+  engine->mode = ENGINE_QUIT;
+}
@@ -0,0 +1,13 @@
+/*
+ *  UCI Interface
+ */
+
+#ifndef UCI_H
+#define UCI_H
+
+struct engine;
+
+void run_uci(struct engine *engine);
+int uci_input_filter(const char *line);
+
+#endif /* UCI_H */
@@ -3,6 +3,7 @@
  */
 
 #include <ctype.h>
+#include <math.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,13 +16,18 @@
 #include "evaluate.h"
 #include "info.h"
 #include "io.h"
+#include "movegen.h"
 #include "options.h"
 #include "os.h"
 #include "search.h"
+#include "uci.h"
 
 /* Buffer sizes for move and position */
 enum { POS_BUF_SIZE = 3, MOVE_BUF_SIZE = 10 };
 
+/* Seconds between updates of thoughts while analysing */
+#define ANALYSE_THOUGHT_INTERVAL 0.5
+
 enum {
   TIME_CTRL_PERIOD_DEFAULT = 5 * 60,
   TIME_CTRL_MPS_DEFAULT = 40,
@@ -66,12 +72,13 @@ static inline void print_statistics(struct engine *engine,
     int black_s = (int)(engine->clock.time_remaining[BLACK]);
     int black_m = black_s / 60;
     black_s %= 60;
-    printf("\n%d : %0.2lf sec : %d:%02d/%d:%02d", evaluate(&engine->game) / 10,
-           time, white_m, white_s, black_m, black_s);
+    printf("\n%d : %0.2lf sec : %d:%02d/%d:%02d",
+           evaluate(&engine->game, 0) / 10, time, white_m, white_s, black_m,
+           black_s);
     if (is_ai_turn(engine) && result) {
       printf(" : %d nodes : b = %0.3lf : %0.2lf knps : %0.2lf%% collisions",
-             result->n_leaf, result->branching_factor,
-             (double)result->n_leaf / (time * 1000.0), result->collisions);
+             result->n_node, result->branching_factor,
+             (double)result->n_node / (time * 1000.0), result->collisions);
     }
     printf("\n\n");
   }
@@ -91,7 +98,9 @@ static inline void print_game_state(struct engine *engine) {
    or suffixed with "(AI)" to indicate AI output. */
 static inline void print_prompt(struct engine *engine) {
   if (!engine->xboard_mode) {
-    if (engine->mode != ENGINE_FORCE_MODE) {
+    if (engine->mode == ENGINE_ANALYSE_MODE) {
+      printf("ANALYSE > ");
+    } else if (engine->mode != ENGINE_FORCE_MODE) {
       printf("%s %s> ", player_text[engine->game.turn],
              engine->game.turn == engine->mode ? "(AI) " : "");
     } else {
@@ -197,6 +206,12 @@ int ui_check_legality(struct engine *engine, struct move *move) {
       print_move_error_msg(engine, "The piece at %s cannot move to %s.\n",
                            move->from, move->to);
       break;
+    case ERR_SELF_CHECK:
+      print_move_error_msg(engine,
+                           "Moving from %s to %s would leave your king in "
+                           "check.\n",
+                           move->from, move->to);
+      break;
     default:
       break;
   }
@@ -204,18 +219,138 @@ int ui_check_legality(struct engine *engine, struct move *move) {
   return result;
 }
 
+/*
+ *  Input while thinking
+ */
+
+/* Commands which invalidate a search in progress */
+static const char *const interrupting_cmds[] = {
+    "force", "new", "q", "quit", "result", "setboard", "fen", "undo",
+};
+enum {
+  N_INTERRUPTING_CMDS = sizeof(interrupting_cmds) / sizeof(*interrupting_cmds)
+};
+
+/* Set when the AI's move should be discarded because a command was received
+ * during the search */
+static volatile int ai_move_aborted;
+
+/* Set while waiting for the opponent's reply to the AI's move during
+ * pondering, and the move which is expected */
+static volatile int pondering;
+static volatile int ponder_missed;
+static struct move ponder_move;
+
+/* The expected move while pondering is a ponder hit, and the search carries on
+ * with the AI's time budget.  Any other move or command apart from clock
+ * updates is a miss, and stops the search. */
+static void ponder_filter(const char *cmd) {
+  if (strcmp(cmd, "time") == 0 || strcmp(cmd, "otim") == 0) return;
+  struct move move;
+  if (parse_move(cmd, &move) == 0 && move_equal(&move, &ponder_move)) {
+    search_pondering = 0;
+  } else {
+    ponder_missed = 1;
+    search_interrupt = 1;
+  }
+  pondering = 0;
+}
+
+/* Set while analysing, when any command stops the search */
+static volatile int analysing;
+
+/* Set from the `uci` command on, when the UCI module filters input */
+static int uci_mode;
+
+/* Called on the input thread with each line read.  "?" makes the AI move now
+ * and "." shows the progress of the search, and neither is queued.  Commands
+ * which invalidate the search also stop it, and are queued to be processed
+ * afterwards. */
+static int ui_input_filter(const char *line) {
+  char cmd[20];
+  if (uci_mode) return uci_input_filter(line);
+  if (sscanf(line, "%19s", cmd) != 1) return 1;
+  if (strcmp(cmd, "uci") == 0) {
+    uci_mode = 1;
+    return 1;
+  }
+  if (strcmp(cmd, "?") == 0) {
+    search_interrupt = 1;
+    return 0;
+  }
+  if (strcmp(cmd, ".") == 0) {
+    search_status_request = 1;
+    return 0;
+  }
+  if (analysing) search_interrupt = 1;
+  for (int i = 0; i < N_INTERRUPTING_CMDS; i++) {
+    if (strcmp(cmd, interrupting_cmds[i]) == 0) {
+      ai_move_aborted = 1;
+      search_interrupt = 1;
+      break;
+    }
+  }
+  if (pondering) ponder_filter(cmd);
+  return 1;
+}
+
 /*
  *  AI actions
  */
 
+/* Search the opponent's expected reply to the AI's move until the opponent
+ * moves, keeping the result in `engine->ponder_result`.  A ponder hit lets the
+ * search run on for the AI's time budget.  After a miss, the AI searches again
+ * with the transposition table warmed up by pondering. */
+static void ponder(struct engine *engine, const struct move *reply) {
+  if (reply->from == reply->to) return;
+  if (check_legality(&engine->game, reply)) return;
+
+  /* The game history is extended by the reply until the search is over */
+  struct position position;
+  copy_position(&position, &engine->game);
+  memcpy(&ponder_move, reply, sizeof(ponder_move));
+  history_push(&engine->history, position.hash);
+  make_move(&position, &ponder_move);
+  change_player(&position);
+
+  double time_budget = clock_get_time_budget(&engine->clock, position.turn);
+  double time_margin = clock_get_time_margin(&engine->clock);
+
+  /* Commands which arrive from here on are checked by `ponder_filter` */
+  search_interrupt = 0;
+  ponder_missed = 0;
+  search_pondering = 1;
+  pondering = 1;
+  if (!input_pending()) {
+    search(engine->search_depth, time_budget, time_margin, &engine->history,
+           &position, &engine->ponder_result, engine->xboard_mode);
+    if (!ponder_missed) engine->ponder_hash = position.hash;
+  }
+  pondering = 0;
+  search_pondering = 0;
+  history_pop(&engine->history);
+}
+
 /* Make the AI move and set the UI up for the next user move. */
 static inline void do_ai_turn(struct engine *engine) {
-  /* Search for AI move */
+  /* Search for AI move, unless pondering has already found it */
   struct search_result result;
-  double time_budget = clock_get_time_budget(&engine->clock, engine->game.turn);
-  double time_margin = clock_get_time_margin(&engine->clock);
-  search(engine->search_depth, time_budget, time_margin, &engine->history,
-         &engine->game, &result, 1);
+  if (engine->ponder_hash && engine->ponder_hash == engine->game.hash) {
+    memcpy(&result, &engine->ponder_result, sizeof(result));
+  } else {
+    double time_budget =
+        clock_get_time_budget(&engine->clock, engine->game.turn);
+    double time_margin = clock_get_time_margin(&engine->clock);
+    search(engine->search_depth, time_budget, time_margin, &engine->history,
+           &engine->game, &result, 1);
+  }
+  engine->ponder_hash = 0;
+  memcpy(&engine->last_result, &result, sizeof(engine->last_result));
+
+  /* Leave the game as it is if a command arrived which invalidates the
+   * search.  It is processed next. */
+  if (ai_move_aborted) return;
 
   /* If no AI move was found, print checkmate or stalemate messages and end the
    * game. */
@@ -240,24 +375,28 @@ static inline void do_ai_turn(struct engine *engine) {
   }
 
   /* Make the AI move */
-  history_push(&engine->history, engine->game.hash, &result.move);
+  struct move ponder_reply;
+  memcpy(&ponder_reply, &result.ponder_move, sizeof(ponder_reply));
+  history_push(&engine->history, engine->game.hash);
   make_move(&engine->game, &result.move);
   clock_end_turn(&engine->clock, engine->game.turn);
   print_ai_move(engine, &result);
   change_player(&engine->game);
   print_game_state(engine);
 
-  /* Search at depth 1 to see if opponent has any moves.  If not, print
-     checkmate or stalemate messages for oppenent and end the game. */
-  search(1, 0.0, 0.0, &engine->history, &engine->game, &result, 0);
-  if (result.move.from == result.move.to) {
-    if (engine->game.check[engine->game.turn]) {
+  /* If the opponent has no legal moves, print checkmate or stalemate messages
+     for the opponent and end the game. */
+  if (!has_legal_move(&engine->game)) {
+    if (in_check(&engine->game)) {
       print_checkmate_message(engine);
     } else {
       print_stalemate_message();
     }
     engine->mode = ENGINE_FORCE_MODE;
+    return;
   }
+
+  if (engine->ponder) ponder(engine, &ponder_reply);
 }
 
 /*
@@ -284,7 +423,7 @@ static inline int accept_move(struct engine *engine, const char *input) {
 
   clock_end_turn(&engine->clock, engine->game.turn);
 
-  history_push(&engine->history, engine->game.hash, &move);
+  history_push(&engine->history, engine->game.hash);
   make_move(&engine->game, &move);
 
   if (is_in_normal_play(engine)) {
@@ -308,7 +447,10 @@ static inline void process_user_input(struct engine *engine) {
   print_prompt(engine);
   const char *input;
   input = get_input();
-  if (input[0] == 0) return;
+  if (input[0] == 0) {
+    if (input_eof()) engine->mode = ENGINE_QUIT;
+    return;
+  }
   if (!accept_message(input)) return;
   if (!accept_command(engine, input)) return;
   if (!accept_move(engine, input)) return;
@@ -317,6 +459,23 @@ static inline void process_user_input(struct engine *engine) {
       -1, -1);
 }
 
+/* Search the current position without a time limit, showing thoughts at a
+ * limited rate, until a command arrives or the search is complete.  Then wait
+ * for a command and process it.  A move made during analysis restarts it from
+ * the new position, with the transposition table still warm. */
+static void analyse(struct engine *engine) {
+  search_interrupt = 0;
+  analysing = 1;
+  if (!input_pending()) {
+    search_thought_interval = ANALYSE_THOUGHT_INTERVAL;
+    search(0, INFINITY, 0.0, &engine->history, &engine->game,
+           &engine->last_result, 1);
+    search_thought_interval = 0.0;
+  }
+  analysing = 0;
+  process_user_input(engine);
+}
+
 /*
  *  Setup and run
  */
@@ -326,11 +485,20 @@ void run_engine(struct engine *engine) {
   if (!engine->xboard_mode) print_program_info();
   print_game_state(engine);
 
+  input_start(ui_input_filter);
   while (engine->mode != ENGINE_QUIT) {
-    if (is_ai_turn(engine))
-      do_ai_turn(engine);
-    else
+    if (is_ai_turn(engine)) {
+      /* Process commands which arrived during the last search before
+       * starting the next one.  Commands arriving from now on interrupt it. */
+      search_interrupt = 0;
+      ai_move_aborted = 0;
+      while (input_pending() && is_ai_turn(engine)) process_user_input(engine);
+      if (is_ai_turn(engine)) do_ai_turn(engine);
+    } else if (engine->mode == ENGINE_ANALYSE_MODE) {
+      analyse(engine);
+    } else {
       process_user_input(engine);
+    }
   }
 }
 
@@ -16,6 +16,82 @@ void init_os(void) {}
 void setup_signal_handlers(void) {}
 void ignore_sigint(void) {}
 
+/*
+ *    Threads
+ */
+
+enum { THREAD_STACK_SIZE = 16 * 1024 * 1024 };
+
+/* Thread handle with the function it runs */
+struct thread {
+  HANDLE handle;
+  thread_fn fn;
+  void *arg;
+};
+
+/* Entry point for a new thread - adapts `thread_fn` to Win32 */
+static DWORD WINAPI thread_entry(LPVOID arg) {
+  struct thread *thread = (struct thread *)arg;
+  thread->fn(thread->arg);
+  return 0;
+}
+
+/* Start a new thread running `fn(arg)`.  Return zero if the thread can't be
+ * created. */
+struct thread *thread_create(thread_fn fn, void *arg) {
+  struct thread *thread = (struct thread *)malloc(sizeof(*thread));
+  if (!thread) return 0;
+  thread->fn = fn;
+  thread->arg = arg;
+  thread->handle = CreateThread(NULL, THREAD_STACK_SIZE, thread_entry, thread,
+                                STACK_SIZE_PARAM_IS_A_RESERVATION, NULL);
+  if (!thread->handle) {
+    free(thread);
+    return 0;
+  }
+  return thread;
+}
+
+/* Wait for a thread to finish and free its handle */
+void thread_join(struct thread *thread) {
+  WaitForSingleObject(thread->handle, INFINITE);
+  CloseHandle(thread->handle);
+  free(thread);
+}
+
+/* Critical section and condition variable */
+struct lock {
+  CRITICAL_SECTION section;
+  CONDITION_VARIABLE cond;
+};
+
+/* Create a lock.  Return zero if it can't be created. */
+struct lock *lock_create(void) {
+  struct lock *lock = (struct lock *)malloc(sizeof(*lock));
+  if (!lock) return 0;
+  InitializeCriticalSection(&lock->section);
+  InitializeConditionVariable(&lock->cond);
+  return lock;
+}
+
+/* Free a lock, which must not be held */
+void lock_destroy(struct lock *lock) {
+  DeleteCriticalSection(&lock->section);
+  free(lock);
+}
+
+void lock_acquire(struct lock *lock) { EnterCriticalSection(&lock->section); }
+
+void lock_release(struct lock *lock) { LeaveCriticalSection(&lock->section); }
+
+/* Release a held lock, wait until notified, then hold it again */
+void lock_wait(struct lock *lock) {
+  SleepConditionVariableCS(&lock->cond, &lock->section, INFINITE);
+}
+
+/* Wake all threads waiting on a lock */
+void lock_notify(struct lock *lock) { WakeAllConditionVariable(&lock->cond); }
+
 /*
  *    Terminal
  */
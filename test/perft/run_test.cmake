@@ -1,19 +1,28 @@
 # Run a perft test to a specified depth and compare to a reference output
 
-# Arguments (required)
+# Arguments (required, except <THREADS>)
 # 0     1  2               3  4               5           6           7
 # cmake -P run_test.cmake -- <REFERENCE DIR> <EXECUTABLE> <TEST NAME> <DEPTH>
+#   8
+#   <THREADS>
 set (reference_dir ${CMAKE_ARGV4})
 set (exename ${CMAKE_ARGV5})
 set (testname ${CMAKE_ARGV6})
 set (depth ${CMAKE_ARGV7})
+set (threads ${CMAKE_ARGV8})
+if (threads)
+  set (outname "${testname}-t${threads}")
+else ()
+  set (threads 1)
+  set (outname "${testname}")
+endif ()
 
 # Reference output file
 set (reference_file ${reference_dir}/${testname}/${testname})
 # Truncated reference output file for comprison with test output
-set (ref_out_file "${testname}-ref.out")
+set (ref_out_file "${outname}-ref.out")
 # Test output file
-set (test_out_file "${testname}-test.out")
+set (test_out_file "${outname}-test.out")
 
 # Empty list items are not ignored
 cmake_policy (SET CMP0007 NEW)
@@ -23,19 +32,19 @@ file (READ "${reference_file}" reference_fen)
 string (REGEX REPLACE "\n.*" "" reference_fen "${reference_fen}")
 
 # Write test stdin to file
-set (input "fen ${reference_fen} getfen perft ${depth} q\n")
-file (WRITE test.in ${input})
+set (input "cores ${threads} fen ${reference_fen} getfen perft ${depth} q\n")
+file (WRITE ${outname}.in ${input})
 
 # Run test
 execute_process(
   COMMAND ${exename} t
-  INPUT_FILE test.in
+  INPUT_FILE ${outname}.in
   OUTPUT_FILE ${test_out_file}
 )
 
 # Cleanup
 execute_process(
-  COMMAND ${CMAKE_COMMAND} -E remove test.in
+  COMMAND ${CMAKE_COMMAND} -E remove ${outname}.in
 )
 
 # Output at depth n will be the fen string then n further lines
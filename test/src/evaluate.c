@@ -0,0 +1,104 @@
+#include "evaluate.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fen.h"
+#include "hash.h"
+#include "movegen.h"
+#include "options.h"
+#include "position.h"
+#include "test.h"
+
+/* Return whether the incrementally kept piece-square scores of `position` are
+ * the same as those calculated from scratch */
+static int piece_square_matches(const struct position *position) {
+  score_t score[N_TAPER];
+  calculate_piece_square(position, score);
+  return score[TAPER_MG] == position->piece_square_score[TAPER_MG] &&
+         score[TAPER_EG] == position->piece_square_score[TAPER_EG];
+}
+
+void test_piece_square(void) {
+  hash_init();
+  init_board();
+  evaluate_init();
+
+  struct position position;
+  reset_board(&position);
+  TEST_ASSERT(position.piece_square_score[TAPER_MG] == 0 &&
+                  position.piece_square_score[TAPER_EG] == 0,
+              "Piece-square scores of the starting position are balanced");
+  TEST_ASSERT(position.material_phase == MAX_MATERIAL_PHASE,
+              "Starting position is at the maximum material phase");
+
+  /* Every legal move of a middlegame with both castling rights, and of an
+   * endgame with en-passant and promotions, so that each piece type moves
+   * from and to many squares in both phases */
+  const char *fens[][4] = {
+      {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R", "w", "KQkq",
+       "-"},
+      {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R", "b", "KQkq",
+       "-"},
+      {"1n6/2P3k1/8/3pP3/8/8/2K3p1/5N2", "w", "-", "d6"},
+      {"1n6/2P3k1/8/3pP3/8/8/2K3p1/5N2", "b", "-", "-"},
+  };
+  int matches = 1;
+  for (int i = 0; i < sizeof(fens) / sizeof(fens[0]); i++) {
+    load_fen(&position, fens[i][0], fens[i][1], fens[i][2], fens[i][3], "0",
+             "1");
+    move_t moves[N_MOVES];
+    int n_moves = generate_legal_moves(&position, moves);
+    for (int j = 0; j < n_moves; j++) {
+      struct move move;
+      struct undo undo;
+      decode_move(moves[j], &move);
+      make_move_save(&position, &move, &undo);
+      if (!piece_square_matches(&position)) matches = 0;
+      change_player(&position);
+      unmake_move(&position, &undo);
+      if (!piece_square_matches(&position)) matches = 0;
+    }
+  }
+  TEST_ASSERT(matches, "Make/unmake keeps the piece-square scores");
+}
+
+void test_symmetry(void) {
+  struct position position, mirrored;
+  load_fen(&position, "1k1r4/1pp4p/p7/4p3/8/P5P1/1PP4P/2K1R3", "w", "-", "-",
+           "0", "1");
+  load_fen(&mirrored, "2k1r3/1pp4p/p5p1/8/4P3/P7/1PP4P/1K1R4", "b", "-", "-",
+           "0", "1");
+  TEST_ASSERT(evaluate(&position, 0) == evaluate(&mirrored, 0),
+              "Mirrored positions have the same score for the side to move");
+}
+
+void test_pawn_hash_options(void) {
+  struct position position;
+  load_fen(&position, "4k3/pp3ppp/8/8/8/2P1P3/2P1PPPP/4K3", "w", "-", "-", "0",
+           "1");
+  evaluate_prepare(&position);
+  score_t before = evaluate(&position, 0);
+  set_option_arg(0, "Doubled pawn penalty=200");
+  evaluate_prepare(&position);
+  score_t cached = evaluate(&position, 0);
+  int mb = pawn_hash_mb;
+  pawn_hash_mb = 0;
+  evaluate_prepare(&position);
+  score_t uncached = evaluate(&position, 0);
+  pawn_hash_mb = mb;
+  set_option_arg(0, "Doubled pawn penalty=50");
+  evaluate_prepare(&position);
+  TEST_ASSERT(cached != before && cached == uncached,
+              "Changing a pawn structure option discards the pawn hash");
+  TEST_ASSERT(evaluate(&position, 0) == before,
+              "Changing it back restores the score");
+}
+
+int main(void) {
+  test_init(1, "evaluate");
+  test_piece_square();
+  test_symmetry();
+  test_pawn_hash_options();
+  return 0;
+}
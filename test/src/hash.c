@@ -2,6 +2,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "fen.h"
 #include "position.h"
@@ -78,6 +79,35 @@ void test_hash(void) {
   }
 }
 
+void test_unmake(void) {
+  hash_init();
+  init_board();
+
+  /* Castling, en-passant, promotion and capture moves from a position with
+   * all of them available */
+  struct position position, start;
+  load_fen(&position, "r3k2r/pPpp1ppp/8/3Pp3/8/8/PPP2PPP/R3K2R", "w", "KQkq",
+           "e6", "0", "1");
+  copy_position(&start, &position);
+  struct move test_moves[] = {
+      {E1, G1, KING, PAWN},  {E1, C1, KING, PAWN},  {D5, E6, PAWN, PAWN},
+      {B7, A8, PAWN, QUEEN}, {B7, B8, PAWN, KNIGHT}, {A1, A8, ROOK, PAWN},
+  };
+  int restored = 1;
+  for (int i = 0; i < sizeof(test_moves) / sizeof(test_moves[0]); i++) {
+    struct undo undo;
+    make_move_save(&position, &test_moves[i], &undo);
+    change_player(&position);
+    unmake_move(&position, &undo);
+    /* Cached moves are refilled on both sides, and `next_id` only counts up */
+    calculate_moves(&position);
+    calculate_moves(&start);
+    start.next_id = position.next_id;
+    if (memcmp(&position, &start, sizeof(position)) != 0) restored = 0;
+  }
+  TEST_ASSERT(restored, "Make/unmake re-creates the original position.");
+}
+
 /*
 void test_hash_position(struct position *position) {
   char buf[1000];
@@ -99,5 +129,6 @@ int main(void) {
   test_prng();
   test_init(1, "hash");
   test_hash();
+  test_unmake();
   return 0;
 }
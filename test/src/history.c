@@ -2,40 +2,87 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "hash.h"
 #include "io.h"
 #include "position.h"
 #include "test.h"
 
+/* Play `moves` from `position`, pushing each position onto `history`.  Return
+ * the index of the last move after which the position is repeated three times,
+ * or -1. */
+static int play_moves(struct position *position, struct history *history,
+                      struct move *moves, int n_moves) {
+  struct search_stack stack;
+  stack_init(&stack, history);
+  int found_at = -1;
+  for (int i = 0; i < n_moves; i++) {
+    history_push(history, position->hash);
+    make_move(position, &moves[i]);
+    change_player(position);
+    if (is_repeated_position(&stack, position->hash, position->halfmove, 3))
+      found_at = i;
+  }
+  return found_at;
+}
+
 void test_history(void) {
   hash_init();
   tt_init();
   init_board();
 
-  {
-    struct move test_moves[] = {
-        {B1, C3, 0, 0}, {B8, C6, 0, 0}, {C3, B1, 0, 0}, {C6, B8, 0, 0},
-        {B1, C3, 0, 0}, {B8, C6, 0, 0}, {C3, B1, 0, 0}, {C6, B8, 0, 0},
-        /* Starting position has been repeated 3 times */
-    };
-    struct history history;
-    history_clear(&history);
-    struct position position;
-    reset_board(&position);
-    int found_at = -1;
-    for (int i = 0; i < sizeof(test_moves) / sizeof(test_moves[0]); i++) {
-      history_push(&history, position.hash, &test_moves[i]);
-      make_move(&position, &test_moves[i]);
-      change_player(&position);
-      if (is_repeated_position(&history, position.hash, 3)) {
-        found_at = i;
-      }
-    }
-    TEST_ASSERT(found_at == 7,
-                "is_repeated_position detects threefold repetition from "
-                "starting position");
-  }
+  struct move test_moves[] = {
+      {B1, C3, 0, 0}, {B8, C6, 0, 0}, {C3, B1, 0, 0}, {C6, B8, 0, 0},
+      {B1, C3, 0, 0}, {B8, C6, 0, 0}, {C3, B1, 0, 0}, {C6, B8, 0, 0},
+      /* Starting position has been repeated 3 times */
+  };
+  const int n_test_moves = sizeof(test_moves) / sizeof(test_moves[0]);
+  struct history history;
+  memset(&history, 0, sizeof(history));
+  struct position position;
+
+  reset_board(&position);
+  TEST_ASSERT(play_moves(&position, &history, test_moves, n_test_moves) == 7,
+              "is_repeated_position detects threefold repetition from "
+              "starting position");
+
+  /* A pawn move resets the halfmove clock, so nothing before it can repeat */
+  struct move pawn_move[] = {{E2, E4, PAWN, PAWN}, {E7, E5, PAWN, PAWN}};
+  history_clear(&history);
+  reset_board(&position);
+  play_moves(&position, &history, test_moves, 4);
+  play_moves(&position, &history, pawn_move, 2);
+  TEST_ASSERT(play_moves(&position, &history, test_moves, 4) == -1,
+              "Positions before an irreversible move are not counted");
+
+  /* The game history grows past its first allocation */
+  history_clear(&history);
+  reset_board(&position);
+  for (int i = 0; i < HISTORY_MIN_SIZE; i += 4)
+    play_moves(&position, &history, test_moves, 4);
+  TEST_ASSERT(history.index == HISTORY_MIN_SIZE &&
+                  play_moves(&position, &history, test_moves, 4) == 3 &&
+                  history.size > HISTORY_MIN_SIZE,
+              "A long game history grows and is checked");
+
+  /* Repetitions within a search, and not across a null move */
+  struct search_stack stack;
+  history_clear(&history);
+  reset_board(&position);
+  stack_init(&stack, &history);
+  hash_t start = position.hash;
+  stack_push(&stack, start);
+  stack_push(&stack, 1);
+  stack_push(&stack, start);
+  stack_push(&stack, 2);
+  TEST_ASSERT(is_repeated_position(&stack, start, 4, 3),
+              "is_repeated_position finds repetitions on the search stack");
+  stack_push_null(&stack);
+  stack_push(&stack, 3);
+  TEST_ASSERT(!is_repeated_position(&stack, start, 6, 2),
+              "A null move stops the search for repetitions");
+  history_free(&history);
 }
 
 int main(void) {
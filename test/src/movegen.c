@@ -0,0 +1,122 @@
+#include "movegen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fen.h"
+#include "hash.h"
+#include "moves.h"
+#include "position.h"
+#include "test.h"
+
+/* Set up a position from FEN fields */
+static void setup_fen(struct position *position, const char *pieces,
+                      const char *turn, const char *castling,
+                      const char *en_passant) {
+  load_fen(position, pieces, turn, castling, en_passant, "0", "1");
+}
+
+/* Count the legal moves by making each pseudo-legal move and testing whether
+ * it leaves the king in check, as a reference */
+static int count_by_making(struct position *position) {
+  int count = 0;
+  bitboard_t pieces = get_my_pieces(position);
+  while (pieces) {
+    enum square from = bit2square(take_next_bit_from(&pieces));
+    int promotes = piece_type[(int)position->piece_at[from]] == PAWN;
+    bitboard_t moves = get_moves(position, from);
+    while (moves) {
+      enum square to = bit2square(take_next_bit_from(&moves));
+      struct move move = {from, to, PAWN, PAWN};
+      if (promotes && is_promotion_move(position, from, to))
+        move.promotion = QUEEN;
+      struct undo undo;
+      make_move_save(position, &move, &undo);
+      if (!in_check(position)) count += (move.promotion == QUEEN) ? 4 : 1;
+      unmake_move(position, &undo);
+    }
+  }
+  return count;
+}
+
+/* The legal move generator agrees with the reference */
+static int legal_moves_match(const char *pieces, const char *turn,
+                             const char *castling, const char *en_passant) {
+  struct position position;
+  move_t moves[N_MOVES];
+  setup_fen(&position, pieces, turn, castling, en_passant);
+  return generate_legal_moves(&position, moves) ==
+         count_by_making(&position);
+}
+
+/* Whether the move from `from` to `to` is generated */
+static int is_generated(const char *pieces, const char *turn,
+                        const char *en_passant, enum square from,
+                        enum square to) {
+  struct position position;
+  move_t moves[N_MOVES];
+  setup_fen(&position, pieces, turn, "-", en_passant);
+  int n_moves = generate_legal_moves(&position, moves);
+  for (int i = 0; i < n_moves; i++)
+    if (move_from(moves[i]) == from && move_to(moves[i]) == to) return 1;
+  return 0;
+}
+
+static int has_legal_move_fen(const char *pieces, const char *turn) {
+  struct position position;
+  setup_fen(&position, pieces, turn, "-", "-");
+  return has_legal_move(&position);
+}
+
+void test_movegen(void) {
+  hash_init();
+  init_board();
+
+  TEST_ASSERT(legal_moves_match("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/"
+                                "PPPBBPPP/R3K2R",
+                                "w", "KQkq", "-"),
+              "Legal moves match the reference in a middlegame");
+  TEST_ASSERT(legal_moves_match("r3k2r/8/3Q4/8/8/5q2/8/R3K2R", "b", "KQkq",
+                                "-"),
+              "Castling through an attacked square");
+  TEST_ASSERT(legal_moves_match("4k3/8/8/8/1b6/8/3N4/4K3", "w", "-", "-"),
+              "A pinned knight can't move");
+  TEST_ASSERT(legal_moves_match("4k3/8/8/8/8/2b5/3R4/4K3", "w", "-", "-"),
+              "A rook pinned on a diagonal can't move");
+  TEST_ASSERT(legal_moves_match("4k3/4r3/8/8/8/8/4R3/4K3", "w", "-", "-"),
+              "A rook pinned on a file moves along it");
+  TEST_ASSERT(legal_moves_match("4k3/8/8/8/8/5n2/8/R3K2R", "w", "-", "-"),
+              "Moves out of a knight check");
+  TEST_ASSERT(legal_moves_match("4k3/8/8/8/8/3n4/8/R3K1r1", "w", "-", "-"),
+              "Only the king moves out of double check");
+  TEST_ASSERT(legal_moves_match("4k3/8/8/2pP4/8/8/8/3K4", "w", "-", "c6"),
+              "En-passant capture");
+  TEST_ASSERT(!is_generated("8/8/8/8/k2Pp2Q/8/8/3K4", "b", "d3", E4, D3),
+              "En-passant capture which exposes the king along the rank");
+  TEST_ASSERT(is_generated("8/8/8/2k5/3Pp3/8/8/3K4", "b", "d3", E4, D3),
+              "En-passant capture of the checking pawn");
+  TEST_ASSERT(is_generated("4k3/8/8/8/8/8/4r3/4K3", "w", "-", E1, E2),
+              "The king takes an undefended checking rook");
+  TEST_ASSERT(!is_generated("4k3/8/8/8/8/8/8/r3K3", "w", "-", E1, F1),
+              "The king can't step back along the line of a check");
+  TEST_ASSERT(!has_legal_move_fen("rnb1kbnr/pppp1ppp/8/4p3/6Pq/5P2/"
+                                  "PPPPP2P/RNBQKBNR",
+                                  "w"),
+              "No legal move in checkmate");
+  TEST_ASSERT(!has_legal_move_fen("7k/5Q2/6K1/8/8/8/8/8", "b"),
+              "No legal move in stalemate");
+  TEST_ASSERT(has_legal_move_fen("4k3/8/8/8/8/8/4r3/4K3", "w"),
+              "A legal move out of check");
+
+  struct position position;
+  setup_fen(&position, "4k3/4r3/8/8/8/8/4N3/4K3", "w", "-", "-");
+  struct move pinned = {E2, C3, KNIGHT, PAWN};
+  TEST_ASSERT(check_legality(&position, &pinned) == ERR_SELF_CHECK,
+              "Moving a pinned piece is reported as self-check");
+}
+
+int main(void) {
+  test_init(1, "movegen");
+  test_movegen();
+  return 0;
+}
@@ -0,0 +1,108 @@
+#include "search.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "evaluate.h"
+#include "fen.h"
+#include "hash.h"
+#include "history.h"
+#include "position.h"
+#include "test.h"
+
+enum { TEST_DEPTH = 6, TEST_LINES = 3 };
+
+void test_multi_pv(void) {
+  hash_init();
+  tt_init();
+  init_board();
+  evaluate_init();
+
+  struct position position;
+  struct history history;
+  struct search_result single, multi;
+  load_fen(&position, "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R",
+           "w", "KQkq", "-", "4", "4");
+
+  memset(&history, 0, sizeof(history));
+  tt_clear();
+  search_multi_pv = 1;
+  search(TEST_DEPTH, 0.0, 0.0, &history, &position, &single, 0);
+  TEST_ASSERT(single.n_lines == 1 &&
+                  single.lines[0].moves[0] == encode_move(&single.move),
+              "A single-PV search has one line, with the best move");
+
+  tt_clear();
+  search_multi_pv = TEST_LINES;
+  search(TEST_DEPTH, 0.0, 0.0, &history, &position, &multi, 0);
+  search_multi_pv = 1;
+  TEST_ASSERT(multi.n_lines == TEST_LINES, "A multi-PV search has all lines");
+  TEST_ASSERT(multi.lines[0].moves[0] == encode_move(&multi.move) &&
+                  multi.lines[0].score == multi.score,
+              "The first line has the best move and score");
+  int distinct = 1, sorted = 1;
+  for (int i = 1; i < multi.n_lines; i++) {
+    for (int j = 0; j < i; j++)
+      if (multi.lines[i].moves[0] == multi.lines[j].moves[0])
+        distinct = 0;
+    if (multi.lines[i].score > multi.lines[i - 1].score) sorted = 0;
+  }
+  TEST_ASSERT(distinct, "Each line starts with a different root move");
+  TEST_ASSERT(sorted, "Lines are sorted by score");
+
+  /* Find the same lines with a separate search for each, excluding the best
+     moves of the searches before it.  Searching the lines in one search
+     reuses the transposition table between them. */
+  long long separate_nodes = 0;
+  double separate_time = 0.0;
+  for (int i = 0; i < TEST_LINES; i++) {
+    struct search_result line;
+    tt_clear();
+    search_n_excluded = i;
+    search(TEST_DEPTH, 0.0, 0.0, &history, &position, &line, 0);
+    search_excluded[i] = encode_move(&line.move);
+    separate_nodes += line.n_node;
+    separate_time += line.time;
+  }
+  search_n_excluded = 0;
+  printf("Nodes: single-PV %d, %d-PV %d, %d separate searches %lld\n",
+         single.n_node, TEST_LINES, multi.n_node, TEST_LINES, separate_nodes);
+  printf("Time: single-PV %.3f s, %d-PV %.3f s, %d separate searches %.3f s\n",
+         single.time, TEST_LINES, multi.time, TEST_LINES, separate_time);
+  TEST_ASSERT(multi.n_node < separate_nodes,
+              "Multi-PV costs less than a separate search for each line");
+}
+
+#ifdef SEARCH_STATS
+void test_stats(void) {
+  struct position position;
+  struct history history;
+  struct search_result result;
+  reset_board(&position);
+  memset(&history, 0, sizeof(history));
+  tt_clear();
+  search(TEST_DEPTH, 0.0, 0.0, &history, &position, &result, 0);
+
+  long long ply_nodes = 0, cutoffs = 0;
+  for (int i = 0; i < SEARCH_DEPTH_MAX; i++)
+    ply_nodes += result.stats.ply_nodes[i];
+  for (int i = 0; i < N_CUTOFF_INDEX; i++)
+    cutoffs += result.stats.cutoff_index[i];
+  TEST_ASSERT(ply_nodes == result.n_node, "Nodes by ply add up to all nodes");
+  TEST_ASSERT(cutoffs == result.n_cutoffs &&
+                  result.stats.cutoff_index[0] == result.n_first_move_cutoffs,
+              "Cutoffs by move number add up to all cutoffs");
+  TEST_ASSERT(result.stats.tt_cutoffs <= result.tt_hits,
+              "TT cutoffs are counted among TT hits");
+}
+#endif
+
+int main(void) {
+  test_init(1, "search");
+  test_multi_pv();
+#ifdef SEARCH_STATS
+  test_stats();
+#endif
+  return 0;
+}
@@ -0,0 +1,40 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fen.h"
+#include "hash.h"
+#include "moves.h"
+#include "position.h"
+#include "test.h"
+
+/* Return the static exchange evaluation of a move in a position */
+static score_t see_fen(const char *pieces, const char *turn, enum square from,
+                       enum square to, enum piece promotion) {
+  struct position position;
+  load_fen(&position, pieces, turn, "-", "-", "0", "1");
+  return see(&position, pack_move(from, to, promotion));
+}
+
+void test_see(void) {
+  hash_init();
+  init_board();
+
+  TEST_ASSERT(see_fen("1k1r4/1pp4p/p7/4p3/8/P5P1/1PP4P/2K1R3", "w", E1, E5,
+                      PAWN) == 100,
+              "Capturing an undefended pawn gains a pawn");
+  TEST_ASSERT(see_fen("1k1r3q/1ppn3p/p4b2/4p3/8/P2N2P1/1PP1R1BP/2K1Q3", "w",
+                      D3, E5, PAWN) == -200,
+              "Knight takes a defended pawn and loses the exchange sequence");
+  TEST_ASSERT(see_fen("4k3/4r3/8/4p3/8/8/4R3/K3R3", "w", E2, E5, PAWN) == 100,
+              "A rook behind the capturing rook joins in by x-ray");
+  TEST_ASSERT(see_fen("4k3/1P6/8/8/8/8/8/K7", "w", B7, B8, QUEEN) == 800,
+              "An undefended promotion gains the promoted piece");
+  TEST_ASSERT(see_fen("1r2k3/P7/8/8/8/8/8/K7", "w", A7, A8, QUEEN) == -100,
+              "A promotion onto a defended square loses the pawn");
+}
+
+int main(void) {
+  test_init(1, "see");
+  test_see();
+  return 0;
+}